@@ -25,6 +25,7 @@
 #include <telepathy-glib/telepathy-glib.h>
 
 #include "channel.h"
+#include "pending-window.h"
 
 #define GET_PRIVATE(obj)	(G_TYPE_INSTANCE_GET_PRIVATE ((obj), TYPE_CHANNEL, ChannelPrivate))
 
@@ -36,9 +37,19 @@ enum /* properties */
   PROP_UNREAD
 };
 
+enum /* signals */
+{
+  UNREAD_CHANGED,
+  LAST_SIGNAL
+};
+
+static guint _signals[LAST_SIGNAL] = { 0, };
+
 typedef struct
 {
-  TpIntSet *pending;
+  PendingWindow *pending;
+  /* the unread count last reported by unread-changed */
+  guint unread;
 } ChannelPrivate;
 
 typedef struct
@@ -51,11 +62,21 @@ static void
 _channel_update_pending_msgs (Channel *self)
 {
   ChannelPrivate *priv = GET_PRIVATE (self);
+  guint unread = pending_window_get_size (priv->pending);
+  gint delta = (gint) unread - (gint) priv->unread;
 
   g_debug ("%s: pending messages %u",
-      tp_proxy_get_object_path (self),
-      tp_intset_size (priv->pending));
+      tp_proxy_get_object_path (self), unread);
+
+  /* a message we already knew about, or an ack for one we didn't */
+  if (delta == 0)
+    return;
 
+  priv->unread = unread;
+
+  /* listeners keeping totals over many channels apply the delta, rather
+   * than reading the unread count of every channel */
+  g_signal_emit (self, _signals[UNREAD_CHANGED], 0, delta);
   g_object_notify (G_OBJECT (self), "unread");
 }
 
@@ -83,7 +104,7 @@ _channel_msg_received (TpChannel *self,
 
   if (type == TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL)
     {
-      tp_intset_add (priv->pending, id);
+      pending_window_add (priv->pending, id);
 
       _channel_update_pending_msgs (CHANNEL (self));
     }
@@ -105,7 +126,7 @@ _channel_pending_msg_removed (TpChannel *self,
     {
       guint id = g_array_index (ids, guint, i);
 
-      tp_intset_remove (priv->pending, id);
+      pending_window_remove (priv->pending, id);
     }
 
   _channel_update_pending_msgs (CHANNEL (self));
@@ -205,7 +226,7 @@ channel_get_property (GObject *self,
   switch (property_id)
     {
       case PROP_UNREAD:
-        g_value_set_uint (value, tp_intset_size (priv->pending));
+        g_value_set_uint (value, pending_window_get_size (priv->pending));
         break;
 
       default:
@@ -221,7 +242,7 @@ channel_dispose (GObject *self)
 
   if (priv->pending != NULL)
     {
-      tp_intset_destroy (priv->pending);
+      pending_window_free (priv->pending);
       priv->pending = NULL;
     }
 
@@ -243,6 +264,15 @@ channel_class_init (ChannelClass *klass)
         0, G_MAXUINT, 0,
         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  _signals[UNREAD_CHANGED] = g_signal_new ("unread-changed",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST,
+      G_STRUCT_OFFSET (ChannelClass, unread_changed),
+      NULL, NULL,
+      g_cclosure_marshal_VOID__INT,
+      G_TYPE_NONE,
+      1, G_TYPE_INT);
+
   g_type_class_add_private (object_class, sizeof (ChannelPrivate));
 }
 
@@ -251,7 +281,13 @@ channel_init (Channel *self)
 {
   ChannelPrivate *priv = GET_PRIVATE (self);
 
-  priv->pending = tp_intset_new ();
+  priv->pending = pending_window_new ();
+}
+
+guint
+channel_get_unread (Channel *self)
+{
+  return GET_PRIVATE (self)->unread;
 }
 
 Channel *
@@ -48,6 +48,9 @@ struct _Channel
 struct _ChannelClass
 {
   TpChannelClass parent_class;
+
+  void (* unread_changed) (Channel *self,
+      gint delta);
 };
 
 GType channel_get_type (void);
@@ -60,6 +63,8 @@ void channel_call_when_ready (Channel *channel,
     TpChannelWhenReadyCb callback,
     gpointer user_data);
 
+guint channel_get_unread (Channel *self);
+
 G_END_DECLS
 
 #endif
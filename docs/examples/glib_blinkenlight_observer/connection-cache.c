@@ -0,0 +1,103 @@
+/*
+ * connection-cache.c - shares TpConnection proxies between dispatches
+ *
+ * Copyright (C) 2010 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "connection-cache.h"
+
+/* Every ObserveChannels or HandleChannels call names the connection its
+ * channels belong to. Creating a new TpConnection for each call means it has
+ * to be prepared again before the channels can be, which is a round trip to
+ * the Connection Manager per dispatch. Instead one proxy is kept per
+ * connection, and dropped when the connection goes away. */
+struct _ConnectionCache
+{
+  TpDBusDaemon *dbus;
+
+  /* object path -> TpConnection */
+  GHashTable *connections;
+};
+
+static void
+_connection_invalidated (TpProxy *conn,
+    guint domain,
+    gint code,
+    char *message,
+    ConnectionCache *self)
+{
+  g_debug ("Connection invalidated: %s", tp_proxy_get_object_path (conn));
+
+  g_signal_handlers_disconnect_by_func (conn,
+      G_CALLBACK (_connection_invalidated), self);
+  g_hash_table_remove (self->connections, tp_proxy_get_object_path (conn));
+}
+
+ConnectionCache *
+connection_cache_new (TpDBusDaemon *dbus)
+{
+  ConnectionCache *self = g_slice_new0 (ConnectionCache);
+
+  self->dbus = g_object_ref (dbus);
+  self->connections = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, g_object_unref);
+
+  return self;
+}
+
+void
+connection_cache_free (ConnectionCache *self)
+{
+  GHashTableIter iter;
+  gpointer conn;
+
+  g_hash_table_iter_init (&iter, self->connections);
+  while (g_hash_table_iter_next (&iter, NULL, &conn))
+    g_signal_handlers_disconnect_by_func (conn,
+        G_CALLBACK (_connection_invalidated), self);
+
+  g_hash_table_destroy (self->connections);
+  g_object_unref (self->dbus);
+
+  g_slice_free (ConnectionCache, self);
+}
+
+/* returns a new reference to the proxy for the connection at @path,
+ * creating it if this is the first time it's been seen */
+TpConnection *
+connection_cache_get (ConnectionCache *self,
+    const char *path,
+    GError **error)
+{
+  TpConnection *conn = g_hash_table_lookup (self->connections, path);
+
+  if (conn != NULL)
+    return g_object_ref (conn);
+
+  conn = tp_connection_new (self->dbus, NULL, path, error);
+  if (conn == NULL)
+    return NULL;
+
+  g_hash_table_insert (self->connections, g_strdup (path),
+      g_object_ref (conn));
+  g_signal_connect (conn, "invalidated",
+      G_CALLBACK (_connection_invalidated), self);
+
+  return conn;
+}
@@ -0,0 +1,41 @@
+/*
+ * connection-cache.h - shares TpConnection proxies between dispatches
+ *
+ * Copyright (C) 2010 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __CONNECTION_CACHE_H__
+#define __CONNECTION_CACHE_H__
+
+#include <glib.h>
+#include <telepathy-glib/connection.h>
+#include <telepathy-glib/dbus.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ConnectionCache ConnectionCache;
+
+ConnectionCache *connection_cache_new (TpDBusDaemon *dbus);
+void connection_cache_free (ConnectionCache *self);
+
+TpConnection *connection_cache_get (ConnectionCache *self,
+    const char *path,
+    GError **error);
+
+G_END_DECLS
+
+#endif
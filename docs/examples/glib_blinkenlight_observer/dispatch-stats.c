@@ -0,0 +1,294 @@
+/*
+ * dispatch-stats.c - histograms of how long each dispatch method takes,
+ *                    exported on D-Bus
+ *
+ * Copyright (C) 2010 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include <dbus/dbus-glib.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+#include <telepathy-glib/svc-generic.h>
+
+#include "dispatch-stats.h"
+
+/* each histogram bucket counts the calls that took less than its bound in
+ * ms, doubling from 1 ms; the last bucket counts everything slower */
+#define NUM_BUCKETS 16
+
+#define GET_PRIVATE(obj)  (G_TYPE_INSTANCE_GET_PRIVATE ((obj), TYPE_DISPATCH_STATS, DispatchStatsPrivate))
+
+G_DEFINE_TYPE_WITH_CODE (DispatchStats, dispatch_stats, G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_DBUS_PROPERTIES,
+      tp_dbus_properties_mixin_iface_init);
+    );
+
+enum /* properties */
+{
+  PROP_0,
+  PROP_HISTOGRAMS,
+  PROP_BUCKET_BOUNDS
+};
+
+typedef struct
+{
+  /* "Method" or "Method.phase" -> guint[NUM_BUCKETS] */
+  GHashTable *histograms;
+} DispatchStatsPrivate;
+
+struct _DispatchTimer
+{
+  DispatchStats *stats;
+  char *method;
+
+  GTimer *timer;
+  /* the phase being timed, and when it started */
+  DispatchPhase phase;
+  gdouble phase_start;
+  gdouble phases[NUM_DISPATCH_PHASES];
+};
+
+static const char *phase_names[] = { "prepare", "calls", "wait" };
+
+static DispatchStats *singleton = NULL;
+
+#define HISTOGRAM_MAP_TYPE \
+  (dbus_g_type_get_map ("GHashTable", G_TYPE_STRING, DBUS_TYPE_G_UINT_ARRAY))
+
+static guint
+bucket_bound (guint bucket)
+{
+  return 1 << bucket;
+}
+
+static void
+dispatch_stats_record (DispatchStats *self,
+    const char *name,
+    gdouble ms)
+{
+  DispatchStatsPrivate *priv = GET_PRIVATE (self);
+  guint *buckets = g_hash_table_lookup (priv->histograms, name);
+  guint bucket;
+
+  if (buckets == NULL)
+    {
+      buckets = g_new0 (guint, NUM_BUCKETS);
+      g_hash_table_insert (priv->histograms, g_strdup (name), buckets);
+    }
+
+  for (bucket = 0; bucket < NUM_BUCKETS - 1; bucket++)
+    if (ms < bucket_bound (bucket))
+      break;
+
+  buckets[bucket]++;
+}
+
+/* starts timing a call of @method, from when it was received */
+DispatchTimer *
+dispatch_timer_new (const char *method)
+{
+  DispatchTimer *self = g_slice_new0 (DispatchTimer);
+
+  self->stats = dispatch_stats_dup ();
+  self->method = g_strdup (method);
+  self->timer = g_timer_new ();
+  self->phase = DISPATCH_PHASE_PREPARE;
+
+  return self;
+}
+
+/* ends the current phase and starts @phase */
+void
+dispatch_timer_mark (DispatchTimer *self,
+    DispatchPhase phase)
+{
+  gdouble now = g_timer_elapsed (self->timer, NULL) * 1000;
+
+  g_return_if_fail (phase < NUM_DISPATCH_PHASES);
+
+  self->phases[self->phase] += now - self->phase_start;
+  self->phase = phase;
+  self->phase_start = now;
+}
+
+/* records the method's time to return and each phase's share of it, and
+ * frees @self */
+void
+dispatch_timer_finish (DispatchTimer *self)
+{
+  guint i;
+
+  dispatch_timer_mark (self, self->phase);
+
+  dispatch_stats_record (self->stats, self->method,
+      g_timer_elapsed (self->timer, NULL) * 1000);
+
+  for (i = 0; i < NUM_DISPATCH_PHASES; i++)
+    {
+      char *name = g_strdup_printf ("%s.%s", self->method, phase_names[i]);
+
+      dispatch_stats_record (self->stats, name, self->phases[i]);
+      g_free (name);
+    }
+
+  g_object_unref (self->stats);
+  g_timer_destroy (self->timer);
+  g_free (self->method);
+
+  g_slice_free (DispatchTimer, self);
+}
+
+static void
+free_uint_array (gpointer array)
+{
+  g_array_free (array, TRUE);
+}
+
+static void
+dispatch_stats_get_property (GObject *self,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  DispatchStatsPrivate *priv = GET_PRIVATE (self);
+
+  switch (property_id)
+    {
+      case PROP_HISTOGRAMS:
+        {
+          GHashTable *histograms = g_hash_table_new_full (g_str_hash,
+              g_str_equal, g_free, free_uint_array);
+          GHashTableIter iter;
+          gpointer key, buckets;
+
+          g_hash_table_iter_init (&iter, priv->histograms);
+          while (g_hash_table_iter_next (&iter, &key, &buckets))
+            {
+              GArray *array = g_array_sized_new (FALSE, FALSE,
+                  sizeof (guint), NUM_BUCKETS);
+
+              g_array_append_vals (array, buckets, NUM_BUCKETS);
+              g_hash_table_insert (histograms, g_strdup (key), array);
+            }
+
+          g_value_take_boxed (value, histograms);
+          break;
+        }
+
+      case PROP_BUCKET_BOUNDS:
+        {
+          GArray *bounds = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+              NUM_BUCKETS - 1);
+          guint i;
+
+          for (i = 0; i < NUM_BUCKETS - 1; i++)
+            {
+              guint bound = bucket_bound (i);
+
+              g_array_append_val (bounds, bound);
+            }
+
+          g_value_take_boxed (value, bounds);
+          break;
+        }
+
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (self, property_id, pspec);
+        break;
+    }
+}
+
+static void
+dispatch_stats_finalize (GObject *self)
+{
+  DispatchStatsPrivate *priv = GET_PRIVATE (self);
+
+  g_hash_table_destroy (priv->histograms);
+
+  G_OBJECT_CLASS (dispatch_stats_parent_class)->finalize (self);
+}
+
+static void
+dispatch_stats_class_init (DispatchStatsClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->get_property = dispatch_stats_get_property;
+  object_class->finalize = dispatch_stats_finalize;
+
+  static TpDBusPropertiesMixinPropImpl stats_props[] = {
+        { "Histograms", "histograms", NULL },
+        { "BucketBounds", "bucket-bounds", NULL },
+        { NULL }
+  };
+
+  static TpDBusPropertiesMixinIfaceImpl prop_interfaces[] = {
+        { DISPATCH_STATS_IFACE,
+          tp_dbus_properties_mixin_getter_gobject_properties,
+          NULL,
+          stats_props
+        },
+        { NULL }
+  };
+
+  g_object_class_install_property (object_class, PROP_HISTOGRAMS,
+      g_param_spec_boxed ("histograms",
+                          "Histograms",
+                          "Call counts per duration bucket, by method and "
+                          "phase",
+                          HISTOGRAM_MAP_TYPE,
+                          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_BUCKET_BOUNDS,
+      g_param_spec_boxed ("bucket-bounds",
+                          "Bucket Bounds",
+                          "The upper bound in ms of each bucket but the last",
+                          DBUS_TYPE_G_UINT_ARRAY,
+                          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  klass->dbus_props_class.interfaces = prop_interfaces;
+  tp_dbus_properties_mixin_class_init (object_class,
+      G_STRUCT_OFFSET (DispatchStatsClass, dbus_props_class));
+
+  g_type_class_add_private (object_class, sizeof (DispatchStatsPrivate));
+}
+
+static void
+dispatch_stats_init (DispatchStats *self)
+{
+  DispatchStatsPrivate *priv = GET_PRIVATE (self);
+
+  priv->histograms = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, g_free);
+}
+
+/* returns the process's stats object, exporting it on the session bus the
+ * first time */
+DispatchStats *
+dispatch_stats_dup (void)
+{
+  if (singleton == NULL)
+    {
+      singleton = g_object_new (TYPE_DISPATCH_STATS, NULL);
+
+      dbus_g_connection_register_g_object (tp_get_bus (),
+          DISPATCH_STATS_OBJECT_PATH, G_OBJECT (singleton));
+    }
+
+  return g_object_ref (singleton);
+}
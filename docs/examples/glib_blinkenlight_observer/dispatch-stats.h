@@ -0,0 +1,76 @@
+/*
+ * dispatch-stats.h - histograms of how long each dispatch method takes,
+ *                    exported on D-Bus
+ *
+ * Copyright (C) 2010 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef __DISPATCH_STATS_H__
+#define __DISPATCH_STATS_H__
+
+#include <glib-object.h>
+#include <telepathy-glib/dbus-properties-mixin.h>
+
+G_BEGIN_DECLS
+
+#define DISPATCH_STATS_IFACE "org.freedesktop.Telepathy.Examples.DispatchStats"
+#define DISPATCH_STATS_OBJECT_PATH "/org/freedesktop/Telepathy/Examples/DispatchStats"
+
+#define TYPE_DISPATCH_STATS	(dispatch_stats_get_type ())
+#define DISPATCH_STATS(obj)	(G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_DISPATCH_STATS, DispatchStats))
+#define DISPATCH_STATS_CLASS(obj)	(G_TYPE_CHECK_CLASS_CAST ((obj), TYPE_DISPATCH_STATS, DispatchStatsClass))
+#define IS_DISPATCH_STATS(obj)	(G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_DISPATCH_STATS))
+#define IS_DISPATCH_STATS_CLASS(obj)	(G_TYPE_CHECK_CLASS_TYPE ((obj), TYPE_DISPATCH_STATS))
+#define DISPATCH_STATS_GET_CLASS(obj)	(G_TYPE_INSTANCE_GET_CLASS ((obj), TYPE_DISPATCH_STATS, DispatchStatsClass))
+
+typedef struct _DispatchStats DispatchStats;
+struct _DispatchStats
+{
+	GObject parent;
+};
+
+typedef struct _DispatchStatsClass DispatchStatsClass;
+struct _DispatchStatsClass
+{
+	GObjectClass parent_class;
+	TpDBusPropertiesMixinClass dbus_props_class;
+};
+
+/* the parts of a dispatch method: setting up proxies, waiting for the calls
+ * made on each channel, and anything after that before returning */
+typedef enum
+{
+  DISPATCH_PHASE_PREPARE,
+  DISPATCH_PHASE_CALLS,
+  DISPATCH_PHASE_WAIT,
+  NUM_DISPATCH_PHASES
+} DispatchPhase;
+
+typedef struct _DispatchTimer DispatchTimer;
+
+GType dispatch_stats_get_type (void);
+DispatchStats *dispatch_stats_dup (void);
+
+DispatchTimer *dispatch_timer_new (const char *method);
+void dispatch_timer_mark (DispatchTimer *self,
+    DispatchPhase phase);
+void dispatch_timer_finish (DispatchTimer *self);
+
+G_END_DECLS
+
+#endif
@@ -28,6 +28,24 @@
 
 #include "observer.h"
 #include "channel.h"
+#include "connection-cache.h"
+#include "dispatch-stats.h"
+#include "output-driver.h"
+#include "unread-snapshot.h"
+
+/* updates to the light wait for this long without a change, and come at
+ * most once per interval */
+#define OUTPUT_DEBOUNCE_MS 100
+#define OUTPUT_INTERVAL_MS 1000
+
+/* the output key of the total count, account keys are object paths */
+#define OUTPUT_TOTAL "total"
+
+/* how often the unread counts are saved, if they've changed, and how long
+ * after starting the counts from the last run are trusted, waiting for the
+ * channels to be recovered */
+#define SNAPSHOT_INTERVAL 30
+#define RECOVER_TIMEOUT 10
 
 static void client_iface_init (gpointer, gpointer);
 static void observer_iface_init (gpointer, gpointer);
@@ -50,49 +68,212 @@ enum /* properties */
 {
   PROP_0,
   PROP_INTERFACES,
-  PROP_CHANNEL_FILTER
+  PROP_CHANNEL_FILTER,
+  PROP_RECOVER
 };
 
 typedef struct
 {
   GList *channels;
+
+  /* created on the first dispatch, and reused by later ones */
+  ConnectionCache *connections;
+
+  /* running unread totals, updated from each channel's unread-changed
+   * deltas; accounts maps an interned account path to its count */
+  GHashTable *accounts;
+  guint total;
+
+  OutputDriver *output;
+
+  /* channel path -> RecoveredChannel, the counts from the last run's
+   * snapshot for channels that haven't been observed yet */
+  GHashTable *recovered;
+  guint recover_id;
+
+  /* whether the counts have changed since the last snapshot */
+  gboolean dirty;
+  guint snapshot_id;
 } ObserverPrivate;
 
+typedef struct
+{
+  const char *account;
+  guint unread;
+} RecoveredChannel;
+
 typedef struct
 {
   Observer *self;
+  const char *account;
   GList *pending;
   DBusGMethodInvocation *context;
+  DispatchTimer *timer;
 } ReadyCallbackData;
 
+static GQuark account_quark = 0;
+
+static void
+_update_count (Observer *self,
+    const char *account,
+    gint delta)
+{
+  ObserverPrivate *priv = GET_PRIVATE (self);
+  guint unread;
+
+  if (delta == 0)
+    return;
+
+  priv->dirty = TRUE;
+
+  unread = GPOINTER_TO_UINT (g_hash_table_lookup (priv->accounts, account));
+  unread += delta;
+  priv->total += delta;
+
+  if (unread > 0)
+    g_hash_table_insert (priv->accounts, (gpointer) account,
+        GUINT_TO_POINTER (unread));
+  else
+    g_hash_table_remove (priv->accounts, account);
+
+  output_driver_set (priv->output, account, unread);
+  output_driver_set (priv->output, OUTPUT_TOTAL, priv->total);
+}
+
+static void
+_output (const char *key,
+    guint unread,
+    gpointer user_data)
+{
+  /* this is where code to interface with the blinking light/whatever goes */
+  if (!tp_strdiff (key, OUTPUT_TOTAL))
+    g_print ("TOTAL UNREAD MESSAGES: %u\n", unread);
+  else
+    g_print ("UNREAD MESSAGES ON %s: %u\n", key, unread);
+}
+
+static void
+recovered_channel_free (RecoveredChannel *recovered)
+{
+  g_slice_free (RecoveredChannel, recovered);
+}
+
+static void
+_snapshot_entry (const UnreadSnapshotEntry *entry,
+    gpointer user_data)
+{
+  Observer *self = user_data;
+  ObserverPrivate *priv = GET_PRIVATE (self);
+  RecoveredChannel *recovered = g_slice_new (RecoveredChannel);
+
+  recovered->account = g_intern_string (entry->account);
+  recovered->unread = entry->unread;
+
+  g_hash_table_insert (priv->recovered, g_strdup (entry->channel), recovered);
+  _update_count (self, recovered->account, recovered->unread);
+}
+
+/* the channel at @path has been observed, its count from the snapshot is
+ * replaced by the real one */
 static void
-_update_count (Observer *self)
+_forget_recovered (Observer *self,
+    const char *path)
 {
   ObserverPrivate *priv = GET_PRIVATE (self);
+  RecoveredChannel *recovered = g_hash_table_lookup (priv->recovered, path);
+
+  if (recovered == NULL)
+    return;
+
+  _update_count (self, recovered->account, - (gint) recovered->unread);
+  g_hash_table_remove (priv->recovered, path);
+}
+
+static gboolean
+_recover_timeout (gpointer user_data)
+{
+  Observer *self = user_data;
+  ObserverPrivate *priv = GET_PRIVATE (self);
+  GHashTableIter iter;
+  gpointer value;
+
+  /* any channel that wasn't recovered by now was closed while we weren't
+   * running */
+  g_hash_table_iter_init (&iter, priv->recovered);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      RecoveredChannel *recovered = value;
+
+      _update_count (self, recovered->account, - (gint) recovered->unread);
+      g_hash_table_iter_remove (&iter);
+    }
+
+  priv->recover_id = 0;
+
+  return FALSE;
+}
+
+static gboolean
+_save_snapshot (gpointer user_data)
+{
+  Observer *self = user_data;
+  ObserverPrivate *priv = GET_PRIVATE (self);
+  GArray *entries;
+  GHashTableIter iter;
+  gpointer key, value;
   GList *ptr;
-  guint total = 0;
+  GError *error = NULL;
+
+  if (!priv->dirty)
+    return TRUE;
+
+  entries = g_array_new (FALSE, FALSE, sizeof (UnreadSnapshotEntry));
 
   for (ptr = priv->channels; ptr != NULL; ptr = ptr->next)
     {
-      guint unread;
+      UnreadSnapshotEntry entry;
 
-      g_object_get (ptr->data,
-          "unread", &unread,
-          NULL);
+      entry.account = g_object_get_qdata (ptr->data, account_quark);
+      entry.channel = tp_proxy_get_object_path (ptr->data);
+      entry.unread = channel_get_unread (CHANNEL (ptr->data));
 
-      total += unread;
+      g_array_append_val (entries, entry);
     }
 
-  /* this is where code to interface with the blinking light/whatever goes */
-  g_print ("TOTAL UNREAD MESSAGES: %u\n", total);
+  /* channels not recovered yet still count */
+  g_hash_table_iter_init (&iter, priv->recovered);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      RecoveredChannel *recovered = value;
+      UnreadSnapshotEntry entry = { recovered->account, key,
+          recovered->unread };
+
+      g_array_append_val (entries, entry);
+    }
+
+  if (unread_snapshot_save ((const UnreadSnapshotEntry *) entries->data,
+        entries->len, &error))
+    {
+      priv->dirty = FALSE;
+    }
+  else
+    {
+      g_warning ("Failed to save unread counts: %s", error->message);
+      g_error_free (error);
+    }
+
+  g_array_free (entries, TRUE);
+
+  return TRUE;
 }
 
 static void
-_channel_update_count (GObject *channel,
-    GParamSpec *pspec,
+_channel_update_count (Channel *channel,
+    gint delta,
     Observer *self)
 {
-  _update_count (self);
+  _update_count (self,
+      g_object_get_qdata (G_OBJECT (channel), account_quark), delta);
 }
 
 static void
@@ -106,9 +287,11 @@ _channel_closed (TpProxy *channel,
 
   g_debug ("Channel closed: %s", tp_proxy_get_object_path (channel));
 
-  /* remove this channel from the list of active channels */
+  /* remove this channel from the list of active channels, and its unread
+   * messages from the totals */
   priv->channels = g_list_remove (priv->channels, channel);
-  _update_count (self);
+  _update_count (self, g_object_get_qdata (G_OBJECT (channel), account_quark),
+      - (gint) channel_get_unread (CHANNEL (channel)));
 
   g_object_unref (channel);
 }
@@ -131,13 +314,19 @@ _channel_ready (TpChannel *channel,
 
       /* put this channel in the list of active channels */
       priv->channels = g_list_prepend (priv->channels, channel);
+      g_object_set_qdata (G_OBJECT (channel), account_quark,
+          (gpointer) data->account);
 
-      tp_g_signal_connect_object (channel, "notify::unread",
+      tp_g_signal_connect_object (channel, "unread-changed",
           G_CALLBACK (_channel_update_count), self, 0);
       tp_g_signal_connect_object (channel, "invalidated",
           G_CALLBACK (_channel_closed), self, 0);
 
-      _update_count (self);
+      /* the messages that were already pending when the channel became
+       * ready, which replace the count saved by the last run */
+      _forget_recovered (self, tp_proxy_get_object_path (channel));
+      _update_count (self, data->account,
+          channel_get_unread (CHANNEL (channel)));
     }
   else
     {
@@ -155,6 +344,7 @@ _channel_ready (TpChannel *channel,
       /* if all channels for this dispatch are ready, we can return from
        * ObserveChannels */
       tp_svc_client_observer_return_from_observe_channels (data->context);
+      dispatch_timer_finish (data->timer);
 
       g_slice_free (ReadyCallbackData, data);
     }
@@ -170,17 +360,27 @@ observer_observe_channels (TpSvcClientObserver *self,
     GHashTable *observer_info,
     DBusGMethodInvocation *context)
 {
-  TpDBusDaemon *dbus = NULL;
+  ObserverPrivate *priv = GET_PRIVATE (self);
+  DispatchTimer *timer = dispatch_timer_new ("ObserveChannels");
   TpConnection *conn = NULL;
   ReadyCallbackData *data = NULL;
   GError *error = NULL;
   guint i;
 
-  dbus = tp_dbus_daemon_dup (&error);
-  if (error != NULL)
-    goto error;
+  if (priv->connections == NULL)
+    {
+      TpDBusDaemon *dbus = tp_dbus_daemon_dup (&error);
 
-  conn = tp_connection_new (dbus, NULL, connection_path, &error);
+      if (error != NULL)
+        goto error;
+
+      priv->connections = connection_cache_new (dbus);
+      g_object_unref (dbus);
+    }
+
+  /* if we've seen channels on this connection before, the proxy is already
+   * prepared */
+  conn = connection_cache_get (priv->connections, connection_path, &error);
   if (error != NULL)
     goto error;
 
@@ -190,9 +390,13 @@ observer_observe_channels (TpSvcClientObserver *self,
    * returning from ObserveChannels until all the channels are ready */
   data = g_slice_new0 (ReadyCallbackData);
   data->self = OBSERVER (self);
+  data->account = g_intern_string (account_path);
   data->context = context;
+  data->timer = timer;
 
   /* build a list of channels and queue them for preparation */
+  dispatch_timer_mark (timer, DISPATCH_PHASE_CALLS);
+
   for (i = 0; i < channels->len; i++)
     {
       GValueArray *channel = g_ptr_array_index (channels, i);
@@ -213,17 +417,28 @@ observer_observe_channels (TpSvcClientObserver *self,
       channel_call_when_ready (chan, _channel_ready, data);
     }
 
+  /* the rest of the time is spent waiting for the channels */
+  dispatch_timer_mark (timer, DISPATCH_PHASE_WAIT);
+
+  if (data->pending == NULL)
+    {
+      /* none of the channels could be created, there's nothing to wait
+       * for */
+      tp_svc_client_observer_return_from_observe_channels (context);
+      dispatch_timer_finish (timer);
+
+      g_slice_free (ReadyCallbackData, data);
+    }
+
   goto finally;
 
 error:
   dbus_g_method_return_error (context, error);
+  dispatch_timer_finish (timer);
 
   g_error_free (error);
 
 finally:
-  if (dbus != NULL)
-    g_object_unref (dbus);
-
   if (conn != NULL)
     g_object_unref (conn);
 }
@@ -256,18 +471,49 @@ observer_get_property (GObject *self,
           break;
         }
 
+      case PROP_RECOVER:
+        /* when we're started, have the Channel Dispatcher call
+         * ObserveChannels for the channels that already exist, so the
+         * counts are right without waiting for new channels */
+        g_value_set_boolean (value, TRUE);
+        break;
+
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (self, property_id, pspec);
         break;
     }
 }
 
+static void
+observer_finalize (GObject *self)
+{
+  ObserverPrivate *priv = GET_PRIVATE (self);
+
+  if (priv->recover_id != 0)
+    g_source_remove (priv->recover_id);
+
+  if (priv->snapshot_id != 0)
+    g_source_remove (priv->snapshot_id);
+
+  g_hash_table_destroy (priv->recovered);
+  g_hash_table_destroy (priv->accounts);
+  output_driver_free (priv->output);
+
+  if (priv->connections != NULL)
+    connection_cache_free (priv->connections);
+
+  G_OBJECT_CLASS (observer_parent_class)->finalize (self);
+}
+
 static void
 observer_class_init (ObserverClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
   object_class->get_property = observer_get_property;
+  object_class->finalize = observer_finalize;
+
+  account_quark = g_quark_from_static_string ("observer-account");
 
   /* D-Bus properties are exposed as GObject properties through the
    * TpDBusPropertiesMixin */
@@ -280,8 +526,7 @@ observer_class_init (ObserverClass *klass)
   /* properties on the Client.Observer interface */
   static TpDBusPropertiesMixinPropImpl client_observer_props[] = {
         { "ObserverChannelFilter", "channel-filter", NULL },
-        /* NB: eventually we'll want to support the Recover property:
-         *     https://bugs.freedesktop.org/show_bug.cgi?id=24768 */
+        { "Recover", "recover", NULL },
         { NULL }
   };
 
@@ -314,6 +559,13 @@ observer_class_init (ObserverClass *klass)
                           TP_ARRAY_TYPE_CHANNEL_CLASS_LIST,
                           G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class, PROP_RECOVER,
+      g_param_spec_boolean ("recover",
+                            "Recover",
+                            "Observe existing channels when started",
+                            TRUE,
+                            G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   /* call our mixin class init */
   klass->dbus_props_class.interfaces = prop_interfaces;
   tp_dbus_properties_mixin_class_init (object_class,
@@ -325,6 +577,28 @@ observer_class_init (ObserverClass *klass)
 static void
 observer_init (Observer *self)
 {
+  ObserverPrivate *priv = GET_PRIVATE (self);
+  GError *error = NULL;
+
+  /* the keys are interned strings, so can be compared directly */
+  priv->accounts = g_hash_table_new (NULL, NULL);
+  priv->output = output_driver_new (OUTPUT_DEBOUNCE_MS, OUTPUT_INTERVAL_MS,
+      _output, self);
+  priv->recovered = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) recovered_channel_free);
+
+  /* report the counts from when we last ran straight away, Recover will
+   * correct them as the channels are observed again */
+  if (!unread_snapshot_load (_snapshot_entry, self, &error))
+    {
+      g_warning ("Failed to load unread counts: %s", error->message);
+      g_error_free (error);
+    }
+
+  priv->recover_id = g_timeout_add_seconds (RECOVER_TIMEOUT,
+      _recover_timeout, self);
+  priv->snapshot_id = g_timeout_add_seconds (SNAPSHOT_INTERVAL,
+      _save_snapshot, self);
 }
 
 static void
@@ -0,0 +1,161 @@
+/*
+ * output-driver.c - debounces and rate-limits the unread counts sent to the
+ *                   blinking light
+ *
+ * Copyright (C) 2010 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "output-driver.h"
+
+/* Unread counts change in bursts: a channel's pending messages are counted
+ * one at a time when it's first observed, and a busy room can deliver many
+ * messages a second. Rather than driving the output for every change, the
+ * latest value for each key is held until no change has come in for the
+ * debounce time, and the output is driven at most once per interval, with
+ * only the keys whose values differ from what was last output.
+ *
+ * A steady stream of changes doesn't hold the output back forever; it is
+ * still updated once per interval. */
+struct _OutputDriver
+{
+  guint debounce_ms;
+  guint interval_ms;
+
+  OutputDriverFunc func;
+  gpointer user_data;
+
+  /* interned key -> value + 1, the latest values and the values last
+   * output */
+  GHashTable *values;
+  GHashTable *output;
+
+  /* times in ms on @timer: when the output was last driven, and when the
+   * oldest change not yet output was made */
+  GTimer *timer;
+  gdouble last_output;
+  gdouble first_change;
+
+  guint timeout_id;
+};
+
+static gdouble
+now_ms (OutputDriver *self)
+{
+  return g_timer_elapsed (self->timer, NULL) * 1000;
+}
+
+static gboolean
+_output_driver_timeout (gpointer user_data)
+{
+  OutputDriver *self = user_data;
+
+  self->timeout_id = 0;
+  output_driver_flush (self);
+
+  return FALSE;
+}
+
+OutputDriver *
+output_driver_new (guint debounce_ms,
+    guint interval_ms,
+    OutputDriverFunc func,
+    gpointer user_data)
+{
+  OutputDriver *self = g_slice_new0 (OutputDriver);
+
+  self->debounce_ms = debounce_ms;
+  self->interval_ms = interval_ms;
+  self->func = func;
+  self->user_data = user_data;
+
+  self->values = g_hash_table_new (NULL, NULL);
+  self->output = g_hash_table_new (NULL, NULL);
+
+  self->timer = g_timer_new ();
+  /* the first change may be output straight after its debounce */
+  self->last_output = - (gdouble) interval_ms;
+
+  return self;
+}
+
+void
+output_driver_free (OutputDriver *self)
+{
+  if (self->timeout_id != 0)
+    g_source_remove (self->timeout_id);
+
+  g_hash_table_destroy (self->values);
+  g_hash_table_destroy (self->output);
+  g_timer_destroy (self->timer);
+
+  g_slice_free (OutputDriver, self);
+}
+
+void
+output_driver_set (OutputDriver *self,
+    const char *key,
+    guint value)
+{
+  gdouble now = now_ms (self);
+  gdouble deadline;
+
+  key = g_intern_string (key);
+  g_hash_table_insert (self->values, (gpointer) key,
+      GUINT_TO_POINTER (value + 1));
+
+  if (self->timeout_id == 0)
+    self->first_change = now;
+  else
+    g_source_remove (self->timeout_id);
+
+  /* wait for the burst to settle, but don't output more often than once
+   * per interval, or later than an interval after the first change */
+  deadline = MAX (now + self->debounce_ms,
+      self->last_output + self->interval_ms);
+  deadline = MIN (deadline,
+      MAX (self->first_change, self->last_output) + self->interval_ms);
+
+  self->timeout_id = g_timeout_add ((guint) MAX (deadline - now, 0),
+      _output_driver_timeout, self);
+}
+
+/* outputs any changed values now */
+void
+output_driver_flush (OutputDriver *self)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  if (self->timeout_id != 0)
+    {
+      g_source_remove (self->timeout_id);
+      self->timeout_id = 0;
+    }
+
+  self->last_output = now_ms (self);
+
+  g_hash_table_iter_init (&iter, self->values);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      /* a value that went up and back down again during the burst */
+      if (g_hash_table_lookup (self->output, key) == value)
+        continue;
+
+      g_hash_table_insert (self->output, key, value);
+      self->func (key, GPOINTER_TO_UINT (value) - 1, self->user_data);
+    }
+}
@@ -0,0 +1,49 @@
+/*
+ * output-driver.h - debounces and rate-limits the unread counts sent to the
+ *                   blinking light
+ *
+ * Copyright (C) 2010 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __OUTPUT_DRIVER_H__
+#define __OUTPUT_DRIVER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _OutputDriver OutputDriver;
+
+/* @key is the key passed to output_driver_set(), interned */
+typedef void (* OutputDriverFunc) (const char *key,
+    guint value,
+    gpointer user_data);
+
+OutputDriver *output_driver_new (guint debounce_ms,
+    guint interval_ms,
+    OutputDriverFunc func,
+    gpointer user_data);
+void output_driver_free (OutputDriver *self);
+
+void output_driver_set (OutputDriver *self,
+    const char *key,
+    guint value);
+void output_driver_flush (OutputDriver *self);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ * pending-window.c - the set of a channel's pending message ids, as a bitmap
+ *                    over the window between the oldest and newest ids
+ *
+ * Copyright (C) 2010 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+
+#include "pending-window.h"
+
+#define BITS_PER_WORD (sizeof (gulong) * 8)
+
+/* Message ids only ever grow over the life of a channel, and messages tend
+ * to be acknowledged roughly in order, so the pending ids sit in a window
+ * that slides upwards. Only the words of the bitmap covering that window are
+ * kept; as the oldest messages are acknowledged the window is rebased, so
+ * memory follows the number of pending messages rather than the largest id
+ * ever seen. */
+struct _PendingWindow
+{
+  /* the bitmap; the words before @head are free and always zero */
+  GArray *words;
+  guint head;
+
+  /* the id of the first bit of words[head], a multiple of BITS_PER_WORD */
+  guint base;
+
+  /* the number of bits set */
+  guint size;
+};
+
+PendingWindow *
+pending_window_new (void)
+{
+  PendingWindow *self = g_slice_new0 (PendingWindow);
+
+  /* new words are zeroed by the array */
+  self->words = g_array_new (FALSE, TRUE, sizeof (gulong));
+
+  return self;
+}
+
+void
+pending_window_free (PendingWindow *self)
+{
+  g_array_free (self->words, TRUE);
+
+  g_slice_free (PendingWindow, self);
+}
+
+/* returns the word holding @id, or NULL if it's outside the window */
+static gulong *
+find_word (PendingWindow *self,
+    guint id)
+{
+  guint word;
+
+  if (id < self->base)
+    return NULL;
+
+  word = self->head + (id - self->base) / BITS_PER_WORD;
+  if (word >= self->words->len)
+    return NULL;
+
+  return &g_array_index (self->words, gulong, word);
+}
+
+/* returns whether @id was newly added */
+gboolean
+pending_window_add (PendingWindow *self,
+    guint id)
+{
+  gulong bit = 1UL << (id % BITS_PER_WORD);
+  gulong *word;
+
+  if (self->size == 0)
+    {
+      /* start a new window at this id */
+      g_array_set_size (self->words, 0);
+      self->head = 0;
+      self->base = id - id % BITS_PER_WORD;
+    }
+  else if (id < self->base)
+    {
+      /* an older message, extend the window downwards, reusing the free
+       * words before the head first */
+      guint n = (self->base - id + BITS_PER_WORD - 1) / BITS_PER_WORD;
+
+      if (n > self->head)
+        {
+          guint extra = n - self->head;
+
+          g_array_set_size (self->words, self->words->len + extra);
+          memmove (&g_array_index (self->words, gulong, extra),
+              self->words->data,
+              (self->words->len - extra) * sizeof (gulong));
+          memset (self->words->data, 0, extra * sizeof (gulong));
+          self->head += extra;
+        }
+
+      self->head -= n;
+      self->base -= n * BITS_PER_WORD;
+    }
+
+  word = find_word (self, id);
+  if (word == NULL)
+    {
+      /* a newer message, extend the window upwards */
+      g_array_set_size (self->words,
+          self->head + (id - self->base) / BITS_PER_WORD + 1);
+      word = find_word (self, id);
+    }
+
+  if (*word & bit)
+    return FALSE;
+
+  *word |= bit;
+  self->size++;
+
+  return TRUE;
+}
+
+/* returns whether @id was pending */
+gboolean
+pending_window_remove (PendingWindow *self,
+    guint id)
+{
+  gulong bit = 1UL << (id % BITS_PER_WORD);
+  gulong *word = find_word (self, id);
+
+  if (word == NULL || !(*word & bit))
+    return FALSE;
+
+  *word &= ~bit;
+  self->size--;
+
+  if (self->size == 0)
+    {
+      g_array_set_size (self->words, 0);
+      self->head = 0;
+
+      return TRUE;
+    }
+
+  /* slide the window past the words that no longer hold any pending
+   * messages */
+  while (g_array_index (self->words, gulong, self->head) == 0)
+    {
+      self->head++;
+      self->base += BITS_PER_WORD;
+    }
+
+  /* once most of the array is free words, drop them */
+  if (self->head > self->words->len / 2)
+    {
+      g_array_remove_range (self->words, 0, self->head);
+      self->head = 0;
+    }
+
+  return TRUE;
+}
+
+gboolean
+pending_window_contains (PendingWindow *self,
+    guint id)
+{
+  gulong *word = find_word (self, id);
+
+  return word != NULL && (*word & (1UL << (id % BITS_PER_WORD))) != 0;
+}
+
+/* the size is kept up to date by add and remove, so this is O(1) */
+guint
+pending_window_get_size (PendingWindow *self)
+{
+  return self->size;
+}
@@ -0,0 +1,44 @@
+/*
+ * pending-window.h - the set of a channel's pending message ids, as a bitmap
+ *                    over the window between the oldest and newest ids
+ *
+ * Copyright (C) 2010 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __PENDING_WINDOW_H__
+#define __PENDING_WINDOW_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PendingWindow PendingWindow;
+
+PendingWindow *pending_window_new (void);
+void pending_window_free (PendingWindow *self);
+
+gboolean pending_window_add (PendingWindow *self,
+    guint id);
+gboolean pending_window_remove (PendingWindow *self,
+    guint id);
+gboolean pending_window_contains (PendingWindow *self,
+    guint id);
+guint pending_window_get_size (PendingWindow *self);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * unread-snapshot.c - saves the unread counts of observed channels, so a
+ *                     restarted observer can report them straight away
+ *
+ * Copyright (C) 2010 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include <stdlib.h>
+#include <glib/gstdio.h>
+
+#include "unread-snapshot.h"
+
+/* The snapshot is a line per channel with unread messages:
+ *
+ *   <unread> <account path> <channel path>
+ *
+ * Object paths can't contain spaces, so no quoting is needed. Channels
+ * without unread messages are left out, so it stays small. */
+
+static char *
+snapshot_path (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), "telepathy-doc",
+      "blinkenlight-unread", NULL);
+}
+
+/* calls @func for each channel in the snapshot; a missing snapshot is not
+ * an error */
+gboolean
+unread_snapshot_load (UnreadSnapshotFunc func,
+    gpointer user_data,
+    GError **error)
+{
+  char *path = snapshot_path ();
+  char *contents = NULL;
+  char **lines, **ptr;
+  GError *lerror = NULL;
+
+  if (!g_file_get_contents (path, &contents, NULL, &lerror))
+    {
+      g_free (path);
+
+      if (g_error_matches (lerror, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        {
+          g_error_free (lerror);
+          return TRUE;
+        }
+
+      g_propagate_error (error, lerror);
+      return FALSE;
+    }
+
+  lines = g_strsplit (contents, "\n", -1);
+
+  for (ptr = lines; *ptr != NULL; ptr++)
+    {
+      char **fields = g_strsplit (*ptr, " ", 3);
+
+      if (g_strv_length (fields) == 3)
+        {
+          UnreadSnapshotEntry entry;
+
+          entry.unread = strtoul (fields[0], NULL, 10);
+          entry.account = fields[1];
+          entry.channel = fields[2];
+
+          func (&entry, user_data);
+        }
+
+      g_strfreev (fields);
+    }
+
+  g_strfreev (lines);
+  g_free (contents);
+  g_free (path);
+
+  return TRUE;
+}
+
+gboolean
+unread_snapshot_save (const UnreadSnapshotEntry *entries,
+    guint n_entries,
+    GError **error)
+{
+  char *path = snapshot_path ();
+  char *dir = g_path_get_dirname (path);
+  GString *contents = g_string_new (NULL);
+  gboolean ret;
+  guint i;
+
+  for (i = 0; i < n_entries; i++)
+    {
+      if (entries[i].unread == 0)
+        continue;
+
+      g_string_append_printf (contents, "%u %s %s\n",
+          entries[i].unread, entries[i].account, entries[i].channel);
+    }
+
+  g_mkdir_with_parents (dir, 0700);
+
+  /* written to a temporary file and renamed, so a crash mid-write leaves
+   * the previous snapshot */
+  ret = g_file_set_contents (path, contents->str, contents->len, error);
+
+  g_string_free (contents, TRUE);
+  g_free (dir);
+  g_free (path);
+
+  return ret;
+}
@@ -0,0 +1,49 @@
+/*
+ * unread-snapshot.h - saves the unread counts of observed channels, so a
+ *                     restarted observer can report them straight away
+ *
+ * Copyright (C) 2010 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef __UNREAD_SNAPSHOT_H__
+#define __UNREAD_SNAPSHOT_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct
+{
+  const char *account;
+  const char *channel;
+  guint unread;
+} UnreadSnapshotEntry;
+
+typedef void (* UnreadSnapshotFunc) (const UnreadSnapshotEntry *entry,
+    gpointer user_data);
+
+gboolean unread_snapshot_load (UnreadSnapshotFunc func,
+    gpointer user_data,
+    GError **error);
+gboolean unread_snapshot_save (const UnreadSnapshotEntry *entries,
+    guint n_entries,
+    GError **error);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,118 @@
+#include "contact-coalescer.h"
+
+struct _ContactCoalescer
+{
+	/* the set of dirty contacts, and the order they were dirtied in;
+	 * each dirty contact holds a reference until it is flushed */
+	GHashTable *dirty;
+	GQueue queue;
+
+	guint max_per_flush;
+	guint idle_id;
+
+	ContactCoalescerFlushFunc func;
+	gpointer user_data;
+};
+
+static gboolean
+_coalescer_flush (gpointer user_data)
+{
+	ContactCoalescer *self = user_data;
+	GPtrArray *batch;
+	guint i;
+
+	/* only take up to max_per_flush contacts per idle, anything left over
+	 * is picked up by the next idle so the main loop isn't blocked for too
+	 * long on a large roster */
+	batch = g_ptr_array_sized_new (
+			MIN (self->max_per_flush, self->queue.length));
+
+	while (batch->len < self->max_per_flush &&
+	       !g_queue_is_empty (&self->queue))
+	{
+		TpContact *contact = g_queue_pop_head (&self->queue);
+
+		g_hash_table_remove (self->dirty, contact);
+		g_ptr_array_add (batch, contact);
+	}
+
+	self->func ((TpContact * const *) batch->pdata, batch->len,
+			self->user_data);
+
+	for (i = 0; i < batch->len; i++)
+	{
+		g_object_unref (g_ptr_array_index (batch, i));
+	}
+	g_ptr_array_free (batch, TRUE);
+
+	if (g_queue_is_empty (&self->queue))
+	{
+		self->idle_id = 0;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+ContactCoalescer *
+contact_coalescer_new (guint			 max_per_flush,
+		       ContactCoalescerFlushFunc func,
+		       gpointer			 user_data)
+{
+	g_return_val_if_fail (max_per_flush > 0, NULL);
+	g_return_val_if_fail (func != NULL, NULL);
+
+	ContactCoalescer *self = g_slice_new0 (ContactCoalescer);
+
+	self->dirty = g_hash_table_new (NULL, NULL);
+	g_queue_init (&self->queue);
+	self->max_per_flush = max_per_flush;
+	self->func = func;
+	self->user_data = user_data;
+
+	return self;
+}
+
+void
+contact_coalescer_free (ContactCoalescer *self)
+{
+	if (self->idle_id != 0)
+	{
+		g_source_remove (self->idle_id);
+	}
+
+	/* drop the references held by contacts that were never flushed */
+	g_queue_foreach (&self->queue, (GFunc) g_object_unref, NULL);
+	g_queue_clear (&self->queue);
+	g_hash_table_destroy (self->dirty);
+
+	g_slice_free (ContactCoalescer, self);
+}
+
+void
+contact_coalescer_mark_dirty (ContactCoalescer	*self,
+			      TpContact		*contact)
+{
+	g_return_if_fail (TP_IS_CONTACT (contact));
+
+	/* a contact that is already dirty will be flushed with its latest
+	 * state anyway, so there's nothing more to do */
+	if (g_hash_table_lookup (self->dirty, contact) != NULL)
+	{
+		return;
+	}
+
+	g_hash_table_insert (self->dirty, contact, contact);
+	g_queue_push_tail (&self->queue, g_object_ref (contact));
+
+	if (self->idle_id == 0)
+	{
+		self->idle_id = g_idle_add (_coalescer_flush, self);
+	}
+}
+
+guint
+contact_coalescer_get_n_dirty (ContactCoalescer *self)
+{
+	return self->queue.length;
+}
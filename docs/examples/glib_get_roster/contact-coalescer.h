@@ -0,0 +1,30 @@
+#ifndef __CONTACT_COALESCER_H__
+#define __CONTACT_COALESCER_H__
+
+#include <glib.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ContactCoalescer ContactCoalescer;
+
+/* called once per idle with the batch of contacts that changed since the
+ * last flush, the contacts are only guaranteed to live for the duration of
+ * the callback */
+typedef void (* ContactCoalescerFlushFunc) (TpContact * const	*contacts,
+					    guint		 n_contacts,
+					    gpointer		 user_data);
+
+ContactCoalescer *contact_coalescer_new (guint			 max_per_flush,
+					 ContactCoalescerFlushFunc func,
+					 gpointer		 user_data);
+void contact_coalescer_free (ContactCoalescer *self);
+
+void contact_coalescer_mark_dirty (ContactCoalescer	*self,
+				   TpContact		*contact);
+guint contact_coalescer_get_n_dirty (ContactCoalescer *self);
+
+G_END_DECLS
+
+#endif
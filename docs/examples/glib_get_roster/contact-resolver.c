@@ -0,0 +1,316 @@
+#include "contact-resolver.h"
+
+struct _ContactResolver
+{
+	TpConnection *conn;
+	TpContactFeature *features;
+	guint n_features;
+	guint chunk_size;
+	guint max_in_flight;
+
+	/* what we're resolving, either handles or ids */
+	GArray *handles;
+	char **ids;
+	guint n_items;
+
+	TpConnectionContactsByHandleCb handle_callback;
+	TpConnectionContactsByIdCb id_callback;
+	ContactResolverDoneCb done;
+	gpointer user_data;
+
+	/* if the weak object goes away, no more chunks are requested and no
+	 * more callbacks are made */
+	GObject *weak_object;
+	gboolean cancelled;
+
+	guint next;		/* the first item not yet requested */
+	guint in_flight;
+	GPtrArray *contacts;	/* every contact resolved so far */
+	GError *error;
+
+	GTimer *timer;
+	gdouble time_to_first_contact;
+};
+
+ContactResolver *
+contact_resolver_new (TpConnection		*conn,
+		      guint			 n_features,
+		      const TpContactFeature	*features,
+		      guint			 chunk_size,
+		      guint			 max_in_flight)
+{
+	g_return_val_if_fail (TP_IS_CONNECTION (conn), NULL);
+	g_return_val_if_fail (chunk_size > 0, NULL);
+	g_return_val_if_fail (max_in_flight > 0, NULL);
+
+	ContactResolver *self = g_slice_new0 (ContactResolver);
+
+	self->conn = g_object_ref (conn);
+	self->features = g_memdup (features,
+			n_features * sizeof (TpContactFeature));
+	self->n_features = n_features;
+	self->chunk_size = chunk_size;
+	self->max_in_flight = max_in_flight;
+	self->contacts = g_ptr_array_new_with_free_func (g_object_unref);
+	self->time_to_first_contact = -1;
+
+	return self;
+}
+
+static void
+_weak_object_finalized (gpointer	 data,
+			GObject		*where_the_object_was)
+{
+	ContactResolver *self = data;
+
+	self->weak_object = NULL;
+	self->cancelled = TRUE;
+}
+
+static void
+contact_resolver_free (ContactResolver *self)
+{
+	if (self->weak_object != NULL)
+	{
+		g_object_weak_unref (self->weak_object,
+				_weak_object_finalized, self);
+	}
+
+	if (self->handles != NULL)
+	{
+		g_array_free (self->handles, TRUE);
+	}
+
+	g_strfreev (self->ids);
+	g_ptr_array_free (self->contacts, TRUE);
+	g_clear_error (&self->error);
+	g_timer_destroy (self->timer);
+	g_free (self->features);
+	g_object_unref (self->conn);
+
+	g_slice_free (ContactResolver, self);
+}
+
+static void _got_contacts_by_handle (TpConnection *, guint,
+		TpContact * const *, guint, const TpHandle *,
+		const GError *, gpointer, GObject *);
+static void _got_contacts_by_id (TpConnection *, guint,
+		TpContact * const *, const gchar * const *, GHashTable *,
+		const GError *, gpointer, GObject *);
+
+static void
+request_next_chunk (ContactResolver *self)
+{
+	guint n = MIN (self->chunk_size, self->n_items - self->next);
+
+	if (self->handles != NULL)
+	{
+		tp_connection_get_contacts_by_handle (self->conn,
+				n, &g_array_index (self->handles, TpHandle,
+					self->next),
+				self->n_features, self->features,
+				_got_contacts_by_handle,
+				self, NULL, NULL);
+	}
+	else
+	{
+		tp_connection_get_contacts_by_id (self->conn,
+				n, (const char * const *) self->ids + self->next,
+				self->n_features, self->features,
+				_got_contacts_by_id,
+				self, NULL, NULL);
+	}
+
+	self->next += n;
+	self->in_flight++;
+}
+
+static void
+fill_pipeline (ContactResolver *self)
+{
+	while (!self->cancelled &&
+	       self->in_flight < self->max_in_flight &&
+	       self->next < self->n_items)
+	{
+		request_next_chunk (self);
+	}
+}
+
+static void
+chunk_done (ContactResolver	*self,
+	    guint		 n_contacts,
+	    TpContact * const	*contacts,
+	    const GError	*error)
+{
+	guint i;
+
+	self->in_flight--;
+
+	if (error != NULL && self->error == NULL)
+	{
+		self->error = g_error_copy (error);
+	}
+
+	if (n_contacts > 0 && self->time_to_first_contact < 0)
+	{
+		self->time_to_first_contact =
+			g_timer_elapsed (self->timer, NULL);
+	}
+
+	for (i = 0; i < n_contacts; i++)
+	{
+		g_ptr_array_add (self->contacts, g_object_ref (contacts[i]));
+	}
+
+	fill_pipeline (self);
+
+	if (self->in_flight > 0 ||
+	    (!self->cancelled && self->next < self->n_items))
+	{
+		return;
+	}
+
+	g_timer_stop (self->timer);
+
+	if (!self->cancelled && self->done != NULL)
+	{
+		self->done (self, self->contacts->len,
+				(TpContact * const *) self->contacts->pdata,
+				self->error, self->user_data);
+	}
+
+	contact_resolver_free (self);
+}
+
+static gboolean
+_resolve_nothing (gpointer user_data)
+{
+	chunk_done (user_data, 0, NULL, NULL);
+
+	return FALSE;
+}
+
+static void
+_got_contacts_by_handle (TpConnection		*conn,
+			 guint			 n_contacts,
+			 TpContact * const	*contacts,
+			 guint			 n_failed,
+			 const TpHandle		*failed,
+			 const GError		*error,
+			 gpointer		 user_data,
+			 GObject		*weak_obj)
+{
+	ContactResolver *self = user_data;
+
+	if (!self->cancelled && self->handle_callback != NULL)
+	{
+		self->handle_callback (conn, n_contacts, contacts,
+				n_failed, failed, error,
+				self->user_data, self->weak_object);
+	}
+
+	chunk_done (self, n_contacts, contacts, error);
+}
+
+static void
+_got_contacts_by_id (TpConnection		*conn,
+		     guint			 n_contacts,
+		     TpContact * const		*contacts,
+		     const gchar * const	*requested_ids,
+		     GHashTable			*failed_id_errors,
+		     const GError		*error,
+		     gpointer			 user_data,
+		     GObject			*weak_obj)
+{
+	ContactResolver *self = user_data;
+
+	if (!self->cancelled && self->id_callback != NULL)
+	{
+		self->id_callback (conn, n_contacts, contacts,
+				requested_ids, failed_id_errors, error,
+				self->user_data, self->weak_object);
+	}
+
+	chunk_done (self, n_contacts, contacts, error);
+}
+
+static void
+start (ContactResolver		*self,
+       ContactResolverDoneCb	 done,
+       gpointer			 user_data,
+       GObject			*weak_object)
+{
+	self->done = done;
+	self->user_data = user_data;
+
+	if (weak_object != NULL)
+	{
+		self->weak_object = weak_object;
+		g_object_weak_ref (weak_object, _weak_object_finalized, self);
+	}
+
+	self->timer = g_timer_new ();
+
+	if (self->n_items == 0)
+	{
+		/* nothing to resolve, but still report completion from the
+		 * main loop like a real request would */
+		self->in_flight++;
+		g_idle_add (_resolve_nothing, self);
+		return;
+	}
+
+	fill_pipeline (self);
+}
+
+void
+contact_resolver_get_contacts_by_handle (ContactResolver	*self,
+		guint				 n_handles,
+		const TpHandle			*handles,
+		TpConnectionContactsByHandleCb	 callback,
+		ContactResolverDoneCb		 done,
+		gpointer			 user_data,
+		GObject				*weak_object)
+{
+	g_return_if_fail (self->handles == NULL && self->ids == NULL);
+
+	self->handles = g_array_sized_new (FALSE, FALSE, sizeof (TpHandle),
+			n_handles);
+	g_array_append_vals (self->handles, handles, n_handles);
+	self->n_items = n_handles;
+	self->handle_callback = callback;
+
+	start (self, done, user_data, weak_object);
+}
+
+void
+contact_resolver_get_contacts_by_id (ContactResolver	*self,
+		guint				 n_ids,
+		const char * const		*ids,
+		TpConnectionContactsByIdCb	 callback,
+		ContactResolverDoneCb		 done,
+		gpointer			 user_data,
+		GObject				*weak_object)
+{
+	guint i;
+
+	g_return_if_fail (self->handles == NULL && self->ids == NULL);
+
+	self->ids = g_new0 (char *, n_ids + 1);
+	for (i = 0; i < n_ids; i++)
+	{
+		self->ids[i] = g_strdup (ids[i]);
+	}
+	self->n_items = n_ids;
+	self->id_callback = callback;
+
+	start (self, done, user_data, weak_object);
+}
+
+/* returns the time in seconds from starting the request until the first
+ * contact arrived, or -1 if no contacts have arrived yet */
+gdouble
+contact_resolver_get_time_to_first_contact (ContactResolver *self)
+{
+	return self->time_to_first_contact;
+}
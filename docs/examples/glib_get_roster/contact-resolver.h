@@ -0,0 +1,55 @@
+#ifndef __CONTACT_RESOLVER_H__
+#define __CONTACT_RESOLVER_H__
+
+#include <glib.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+/* A ContactResolver turns a large set of handles or identifiers into
+ * TpContacts by splitting them into chunks and keeping a bounded number of
+ * requests in flight at once. The per-chunk callback is the same one that
+ * tp_connection_get_contacts_by_handle() or tp_connection_get_contacts_by_id()
+ * would take, and is called as each chunk arrives, so the first contacts can
+ * be shown long before the last ones are resolved.
+ *
+ * A resolver is used for a single request, and frees itself after calling
+ * its ContactResolverDoneCb. */
+typedef struct _ContactResolver ContactResolver;
+
+/* @contacts is every contact resolved, @error is the first error any chunk
+ * failed with, or NULL */
+typedef void (* ContactResolverDoneCb) (ContactResolver		*resolver,
+					guint			 n_contacts,
+					TpContact * const	*contacts,
+					const GError		*error,
+					gpointer		 user_data);
+
+ContactResolver *contact_resolver_new (TpConnection		*conn,
+				       guint			 n_features,
+				       const TpContactFeature	*features,
+				       guint			 chunk_size,
+				       guint			 max_in_flight);
+
+void contact_resolver_get_contacts_by_handle (ContactResolver	*self,
+		guint				 n_handles,
+		const TpHandle			*handles,
+		TpConnectionContactsByHandleCb	 callback,
+		ContactResolverDoneCb		 done,
+		gpointer			 user_data,
+		GObject				*weak_object);
+
+void contact_resolver_get_contacts_by_id (ContactResolver	*self,
+		guint				 n_ids,
+		const char * const		*ids,
+		TpConnectionContactsByIdCb	 callback,
+		ContactResolverDoneCb		 done,
+		gpointer			 user_data,
+		GObject				*weak_object);
+
+gdouble contact_resolver_get_time_to_first_contact (ContactResolver *self);
+
+G_END_DECLS
+
+#endif
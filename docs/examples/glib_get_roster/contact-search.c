@@ -0,0 +1,293 @@
+#include <string.h>
+
+#include "contact-search.h"
+
+/* The index is a sorted array of (key, contact) entries, so the contacts
+ * matching a prefix are a contiguous run found by one binary search, and
+ * adding or removing a contact is a binary search and a memmove per key. */
+typedef struct
+{
+	const char *key;
+	TpContact *contact;
+} SearchEntry;
+
+struct _ContactSearch
+{
+	/* SearchEntries, sorted by key and then by contact */
+	GArray *entries;
+
+	/* contact -> NULL-terminated array of the keys it's indexed under,
+	 * which own the strings the entries point to */
+	GHashTable *keys;
+};
+
+ContactSearch *
+contact_search_new (void)
+{
+	ContactSearch *self = g_slice_new0 (ContactSearch);
+
+	self->entries = g_array_new (FALSE, FALSE, sizeof (SearchEntry));
+	self->keys = g_hash_table_new_full (NULL, NULL, NULL,
+			(GDestroyNotify) g_strfreev);
+
+	return self;
+}
+
+void
+contact_search_free (ContactSearch *self)
+{
+	g_array_free (self->entries, TRUE);
+	g_hash_table_destroy (self->keys);
+
+	g_slice_free (ContactSearch, self);
+}
+
+/* folds case and strips accents, so that "Émile" and "emile" match */
+char *
+contact_search_normalize (const char *str)
+{
+	char *decomposed, *folded;
+	const char *p;
+	GString *normalized;
+
+	/* NFKD splits accented characters into a base character and
+	 * combining marks, which are then dropped */
+	decomposed = g_utf8_normalize (str != NULL ? str : "", -1,
+			G_NORMALIZE_ALL);
+	if (decomposed == NULL)
+	{
+		/* not valid UTF-8 */
+		return g_strdup ("");
+	}
+
+	folded = g_utf8_casefold (decomposed, -1);
+	normalized = g_string_sized_new (strlen (folded));
+
+	for (p = folded; *p != '\0'; p = g_utf8_next_char (p))
+	{
+		gunichar c = g_utf8_get_char (p);
+
+		if (!g_unichar_ismark (c))
+		{
+			g_string_append_unichar (normalized, c);
+		}
+	}
+
+	g_free (decomposed);
+	g_free (folded);
+
+	return g_string_free (normalized, FALSE);
+}
+
+static int
+entry_compare (const char	*key,
+	       TpContact	*contact,
+	       const SearchEntry *entry)
+{
+	int cmp = strcmp (key, entry->key);
+
+	if (cmp != 0)
+	{
+		return cmp;
+	}
+
+	return contact < entry->contact ? -1 : contact > entry->contact;
+}
+
+/* returns the index of the first entry not less than (@key, @contact) */
+static guint
+entry_lower_bound (ContactSearch	*self,
+		   const char		*key,
+		   TpContact		*contact)
+{
+	guint lo = 0, hi = self->entries->len;
+
+	while (lo < hi)
+	{
+		guint mid = lo + (hi - lo) / 2;
+
+		if (entry_compare (key, contact, &g_array_index (self->entries,
+					SearchEntry, mid)) > 0)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static void
+add_key (GPtrArray	*keys,
+	 const char	*key)
+{
+	guint i;
+
+	if (*key == '\0')
+	{
+		return;
+	}
+
+	/* a contact whose alias is its identifier only needs one entry */
+	for (i = 0; i < keys->len; i++)
+	{
+		if (!strcmp (g_ptr_array_index (keys, i), key))
+		{
+			return;
+		}
+	}
+
+	g_ptr_array_add (keys, g_strdup (key));
+}
+
+static char **
+contact_keys (TpContact *contact)
+{
+	GPtrArray *keys = g_ptr_array_new ();
+	char *identifier, *alias;
+	const char *p;
+	gboolean in_word = TRUE;
+
+	identifier = contact_search_normalize (
+			tp_contact_get_identifier (contact));
+	alias = contact_search_normalize (tp_contact_get_alias (contact));
+
+	add_key (keys, identifier);
+	add_key (keys, alias);
+
+	/* index each later word of the alias, so typing a surname finds
+	 * the contact too */
+	for (p = alias; *p != '\0'; p = g_utf8_next_char (p))
+	{
+		gboolean alnum = g_unichar_isalnum (g_utf8_get_char (p));
+
+		if (alnum && !in_word)
+		{
+			add_key (keys, p);
+		}
+
+		in_word = alnum;
+	}
+
+	g_ptr_array_add (keys, NULL);
+
+	g_free (identifier);
+	g_free (alias);
+
+	return (char **) g_ptr_array_free (keys, FALSE);
+}
+
+void
+contact_search_remove (ContactSearch	*self,
+		       TpContact	*contact)
+{
+	char **keys = g_hash_table_lookup (self->keys, contact);
+	guint i;
+
+	if (keys == NULL)
+	{
+		return;
+	}
+
+	for (i = 0; keys[i] != NULL; i++)
+	{
+		guint index = entry_lower_bound (self, keys[i], contact);
+
+		g_array_remove_index (self->entries, index);
+	}
+
+	g_hash_table_remove (self->keys, contact);
+}
+
+/* adds @contact to the index, or reindexes it if it's already there, for
+ * instance after its alias changes */
+void
+contact_search_add (ContactSearch	*self,
+		    TpContact		*contact)
+{
+	char **old_keys = g_hash_table_lookup (self->keys, contact);
+	char **keys = contact_keys (contact);
+	guint i;
+
+	if (old_keys != NULL)
+	{
+		/* nothing to do if the alias change didn't change any keys */
+		for (i = 0; keys[i] != NULL && old_keys[i] != NULL; i++)
+		{
+			if (strcmp (keys[i], old_keys[i]) != 0)
+			{
+				break;
+			}
+		}
+
+		if (keys[i] == NULL && old_keys[i] == NULL)
+		{
+			g_strfreev (keys);
+			return;
+		}
+
+		contact_search_remove (self, contact);
+	}
+
+	for (i = 0; keys[i] != NULL; i++)
+	{
+		SearchEntry entry = { keys[i], contact };
+
+		g_array_insert_val (self->entries,
+				entry_lower_bound (self, keys[i], contact),
+				entry);
+	}
+
+	g_hash_table_insert (self->keys, contact, keys);
+}
+
+/* fills @results with up to @max_results contacts with a key starting with
+ * @prefix, in key order, and returns how many were found */
+guint
+contact_search_lookup (ContactSearch	*self,
+		       const char	*prefix,
+		       guint		 max_results,
+		       TpContact	**results)
+{
+	char *normalized = contact_search_normalize (prefix);
+	gsize len = strlen (normalized);
+	guint i, n = 0;
+
+	/* NULL sorts before any contact, so this is the first entry whose
+	 * key is >= the prefix */
+	for (i = entry_lower_bound (self, normalized, NULL);
+	     i < self->entries->len && n < max_results;
+	     i++)
+	{
+		SearchEntry *entry = &g_array_index (self->entries,
+				SearchEntry, i);
+		guint j;
+
+		if (strncmp (entry->key, normalized, len) != 0)
+		{
+			break;
+		}
+
+		/* a contact can match on more than one key, only list it
+		 * once */
+		for (j = 0; j < n && results[j] != entry->contact; j++);
+
+		if (j == n)
+		{
+			results[n++] = entry->contact;
+		}
+	}
+
+	g_free (normalized);
+
+	return n;
+}
+
+guint
+contact_search_get_n_keys (ContactSearch *self)
+{
+	return self->entries->len;
+}
@@ -0,0 +1,37 @@
+#ifndef __CONTACT_SEARCH_H__
+#define __CONTACT_SEARCH_H__
+
+#include <glib.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+/* A prefix index over the aliases and identifiers of a set of contacts,
+ * for finding contacts as the user types.
+ *
+ * Each contact is indexed under its identifier, its alias, and each later
+ * word of its alias, all normalized so that case and accents don't matter.
+ * The index doesn't hold references to the contacts, they must be removed
+ * before they're finalized. */
+typedef struct _ContactSearch ContactSearch;
+
+ContactSearch *contact_search_new (void);
+void contact_search_free (ContactSearch *self);
+
+void contact_search_add (ContactSearch	*self,
+			 TpContact	*contact);
+void contact_search_remove (ContactSearch	*self,
+			    TpContact		*contact);
+
+guint contact_search_lookup (ContactSearch	*self,
+			     const char		*prefix,
+			     guint		 max_results,
+			     TpContact		**results);
+guint contact_search_get_n_keys (ContactSearch *self);
+
+char *contact_search_normalize (const char *str);
+
+G_END_DECLS
+
+#endif
@@ -1,12 +1,63 @@
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <glib.h>
 
 #include <telepathy-glib/telepathy-glib.h>
 
+#include "contact-coalescer.h"
+#include "contact-resolver.h"
+#include "contact-search.h"
+#include "presence-log.h"
+#include "presence-table.h"
+#include "roster-snapshot.h"
+#include "roster-sync.h"
+#include "string-pool.h"
+
+/* the maximum number of contacts to print per main loop iteration */
+#define MAX_CONTACTS_PER_FLUSH 200
+
+/* large contact lists are resolved in chunks of this many handles, with at
+ * most this many requests outstanding at once */
+#define CONTACTS_PER_REQUEST 100
+#define MAX_REQUESTS_IN_FLIGHT 4
+
+/* the number of matches to print for a search */
+#define MAX_SEARCH_RESULTS 10
+
 static GMainLoop *loop = NULL;
 static TpDBusDaemon *bus_daemon = NULL;
 static TpConnection *conn = NULL;
+static ContactCoalescer *coalescer = NULL;
+static StringPool *strings = NULL;
+static PresenceTable *presences = NULL;
+static PresenceRecorder *recorder = NULL;
+static ContactSearch *search = NULL;
+
+/* the account's roster, the set of contacts on the publish and subscribe
+ * lists; the roster holds a reference to each contact */
+static const char *roster_lists[] = { "publish", "subscribe", NULL };
+#define ROSTER_LISTS_ALL ((1 << (G_N_ELEMENTS (roster_lists) - 1)) - 1)
+static guint roster_lists_ready = 0;
+static GHashTable *roster = NULL;
+
+/* list name -> RosterSync, the members each list had last time it was seen,
+ * so that a list announced again only has its new members resolved */
+static GHashTable *list_members = NULL;
+
+/* the roster as it was last time we were connected */
+static char *account = NULL;
+static RosterSnapshot *snapshot = NULL;
+
+static int
+compare_handles (const void	*a,
+		 const void	*b)
+{
+	TpHandle ha = *(const TpHandle *) a, hb = *(const TpHandle *) b;
+
+	return ha < hb ? -1 : ha > hb;
+}
 
 static void
 handle_error (const GError *error)
@@ -19,6 +70,214 @@ handle_error (const GError *error)
 	}
 }
 
+static void
+show_snapshot (void)
+{
+	guint i, n = roster_snapshot_get_n_entries (snapshot);
+
+	g_print (" > cached roster for %s (%u contacts)\n", account, n);
+
+	for (i = 0; i < n; i++)
+	{
+		RosterSnapshotEntry entry;
+
+		roster_snapshot_get_entry (snapshot, i, &entry);
+
+		g_print ("  ~ %s (%s)\t\t%s - %s\n",
+				entry.alias,
+				entry.identifier,
+				entry.presence_status,
+				entry.presence_message);
+	}
+}
+
+static void
+snapshot_diff_cb (RosterSnapshotChange		 change,
+		  const RosterSnapshotEntry	*entry,
+		  TpContact			*contact,
+		  gpointer			 user_data)
+{
+	switch (change)
+	{
+		case ROSTER_SNAPSHOT_ADDED:
+			g_print ("  + %s (%s)\n",
+					tp_contact_get_alias (contact),
+					tp_contact_get_identifier (contact));
+			break;
+
+		case ROSTER_SNAPSHOT_REMOVED:
+			g_print ("  x %s (%s)\n",
+					entry->alias, entry->identifier);
+			break;
+
+		case ROSTER_SNAPSHOT_CHANGED:
+			g_print ("  * %s (%s)\t\t%s -> %s\n",
+					tp_contact_get_alias (contact),
+					tp_contact_get_identifier (contact),
+					entry->presence_status,
+					tp_contact_get_presence_status (contact));
+			break;
+	}
+}
+
+static void
+save_snapshot (void)
+{
+	GError *error = NULL;
+	GPtrArray *contacts = g_ptr_array_sized_new (g_hash_table_size (roster));
+	GHashTableIter iter;
+	gpointer contact;
+
+	g_hash_table_iter_init (&iter, roster);
+	while (g_hash_table_iter_next (&iter, &contact, NULL))
+	{
+		g_ptr_array_add (contacts, contact);
+	}
+
+	if (!roster_snapshot_save (account,
+				(TpContact * const *) contacts->pdata,
+				contacts->len, &error))
+	{
+		g_print ("ERROR: could not save roster snapshot: %s\n",
+				error->message);
+		g_error_free (error);
+	}
+
+	g_ptr_array_free (contacts, TRUE);
+}
+
+static void
+roster_list_ready (const char *list)
+{
+	GHashTableIter iter;
+	gpointer contact;
+	guint i;
+
+	if (roster_lists_ready == ROSTER_LISTS_ALL)
+	{
+		/* a list was seen again, the changes have already been
+		 * printed */
+		return;
+	}
+
+	for (i = 0; roster_lists[i] != NULL; i++)
+	{
+		if (!strcmp (list, roster_lists[i]))
+		{
+			roster_lists_ready |= 1 << i;
+		}
+	}
+
+	if (roster_lists_ready != ROSTER_LISTS_ALL)
+	{
+		return;
+	}
+
+	/* we now have the whole roster, print what changed since the
+	 * snapshot was taken */
+	g_print (" > roster changes since last run\n");
+
+	GPtrArray *contacts = g_ptr_array_sized_new (g_hash_table_size (roster));
+
+	g_hash_table_iter_init (&iter, roster);
+	while (g_hash_table_iter_next (&iter, &contact, NULL))
+	{
+		g_ptr_array_add (contacts, contact);
+	}
+
+	roster_snapshot_diff (snapshot,
+			(TpContact * const *) contacts->pdata, contacts->len,
+			snapshot_diff_cb, NULL);
+
+	g_ptr_array_free (contacts, TRUE);
+
+	save_snapshot ();
+}
+
+static void
+contacts_flushed_cb (TpContact * const	*contacts,
+		     guint		 n_contacts,
+		     gpointer		 user_data)
+{
+	guint i;
+
+	for (i = 0; i < n_contacts; i++)
+	{
+		TpContact *contact = contacts[i];
+
+		g_print ("  - %s (%s)\t\t%s - %s\n",
+				tp_contact_get_alias (contact),
+				tp_contact_get_identifier (contact),
+				tp_contact_get_presence_status (contact),
+				tp_contact_get_presence_message (contact));
+	}
+
+	if (contact_coalescer_get_n_dirty (coalescer) > 0)
+	{
+		g_print (" %% %u more contacts pending\n",
+				contact_coalescer_get_n_dirty (coalescer));
+	}
+}
+
+static void
+contact_alias_cb (TpContact	*contact,
+		  GParamSpec	*pspec,
+		  gpointer	 user_data)
+{
+	/* the contact's keys in the index depend on its alias */
+	contact_search_add (search, contact);
+}
+
+static void
+contact_changed_cb (TpContact	*contact,
+		    GParamSpec	*pspec,
+		    gpointer	 user_data)
+{
+	/* a single presence or alias change notifies several properties,
+	 * and a reconnect notifies every contact on the roster; rather than
+	 * printing the contact for each one, mark it dirty and print it once
+	 * from an idle */
+	contact_coalescer_mark_dirty (coalescer, contact);
+}
+
+static void contact_notify_cb (TpContact *contact, GParamSpec *pspec,
+		gpointer user_data);
+
+/* adds the contacts contacts_ready() has just referenced to the roster;
+ * their notifications are coalesced rather than printed each time, and
+ * they are added to the search index */
+static void
+track_contacts (guint			 n_contacts,
+		TpContact * const	*contacts)
+{
+	guint i;
+
+	for (i = 0; i < n_contacts; i++)
+	{
+		TpContact *contact = contacts[i];
+
+		g_signal_handlers_disconnect_by_func (contact,
+				G_CALLBACK (contact_notify_cb), NULL);
+
+		/* contacts can be on more than one list, but we only need to
+		 * track them once */
+		if (g_hash_table_lookup (roster, contact) != NULL)
+		{
+			g_object_unref (contact);
+			continue;
+		}
+
+		/* the roster takes over contacts_ready()'s reference */
+		g_hash_table_insert (roster, contact, contact);
+
+		g_signal_connect (contact, "notify",
+				G_CALLBACK (contact_changed_cb), NULL);
+		g_signal_connect (contact, "notify::alias",
+				G_CALLBACK (contact_alias_cb), NULL);
+		contact_search_add (search, contact);
+	}
+}
+
 /* begin ex.sect.contactinfo.contacts.glib.tpcontact */
 static void
 contact_notify_cb (TpContact	*contact,
@@ -66,17 +325,42 @@ contacts_ready (TpConnection		*conn,
 
 		contact_notify_cb (contact, NULL, NULL);
 	}
+	/* end ex.sect.contactinfo.contacts.glib.tpcontact */
+
+	track_contacts (n_contacts, contacts);
 }
-/* end ex.sect.contactinfo.contacts.glib.tpcontact */
 
 static void
-channel_ready (TpChannel	*channel,
-	       const GError	*in_error,
-	       gpointer		 user_data)
+contacts_resolved (ContactResolver	*resolver,
+		   guint		 n_contacts,
+		   TpContact * const	*contacts,
+		   const GError		*error,
+		   gpointer		 user_data)
+{
+	TpChannel *channel = TP_CHANNEL (user_data);
+
+	g_print (" > all contacts resolved for %s (%u contacts, "
+			"first contact after %.3fs)\n",
+			tp_channel_get_identifier (channel),
+			n_contacts,
+			contact_resolver_get_time_to_first_contact (resolver));
+
+	roster_list_ready (tp_channel_get_identifier (channel));
+}
+
+/* called once tp_connection_get_contacts_by_handle() has finished with
+ * @user_data, after contacts_ready */
+static void
+members_done (gpointer user_data)
 {
-	g_print (" > channel_ready (%s)\n",
-			tp_channel_get_identifier (channel));
+	TpChannel *channel = TP_CHANNEL (user_data);
+
+	roster_list_ready (tp_channel_get_identifier (channel));
+}
 
+static void
+get_members (TpChannel *channel)
+{
 	/* begin ex.sect.contactinfo.contacts.glib.members */
 	const TpIntSet *members = tp_channel_group_get_members (channel);
 	GArray *handles = tp_intset_to_array (members);
@@ -92,12 +376,177 @@ channel_ready (TpChannel	*channel,
 			handles->len, (const TpHandle *) handles->data,
 			G_N_ELEMENTS (features), features,
 			contacts_ready,
-			channel, NULL, NULL);
+			channel, members_done, NULL);
 
 	g_array_free (handles, TRUE);
 	/* end ex.sect.contactinfo.contacts.glib.members */
 }
 
+/* like get_members(), but for @handles, which may be too many to ask for in
+ * one request */
+static void
+resolve_members (TpChannel	*channel,
+		 GArray		*handles)
+{
+	static const TpContactFeature features[] = {
+		TP_CONTACT_FEATURE_ALIAS,
+		TP_CONTACT_FEATURE_PRESENCE
+	};
+
+	/* rather than asking for every member in one request, which for a
+	 * large roster means a long wait for one very large reply, the
+	 * resolver asks for them in chunks, and contacts_ready is called as
+	 * each chunk arrives */
+	ContactResolver *resolver = contact_resolver_new (conn,
+			G_N_ELEMENTS (features), features,
+			CONTACTS_PER_REQUEST, MAX_REQUESTS_IN_FLIGHT);
+
+	contact_resolver_get_contacts_by_handle (resolver,
+			handles->len, (const TpHandle *) handles->data,
+			contacts_ready, contacts_resolved,
+			channel, NULL);
+}
+
+/* whether @handle is a member of any of the contact lists */
+static gboolean
+on_any_list (TpHandle handle)
+{
+	GHashTableIter iter;
+	gpointer sync;
+
+	g_hash_table_iter_init (&iter, list_members);
+	while (g_hash_table_iter_next (&iter, NULL, &sync))
+	{
+		if (roster_sync_contains (sync, handle))
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* drops the contacts for @removed, a sorted array of handles that left a
+ * list, from the roster, unless they're still on another list */
+static void
+remove_members (GArray *removed)
+{
+	GHashTableIter iter;
+	gpointer key;
+
+	if (removed->len == 0)
+	{
+		return;
+	}
+
+	g_hash_table_iter_init (&iter, roster);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+	{
+		TpContact *contact = TP_CONTACT (key);
+		TpHandle handle = tp_contact_get_handle (contact);
+
+		if (bsearch (&handle, removed->data, removed->len,
+					sizeof (TpHandle), compare_handles) == NULL ||
+		    on_any_list (handle))
+		{
+			continue;
+		}
+
+		g_print ("  x %s (%s)\n",
+				tp_contact_get_alias (contact),
+				tp_contact_get_identifier (contact));
+
+		g_signal_handlers_disconnect_by_func (contact,
+				G_CALLBACK (contact_changed_cb), NULL);
+		g_signal_handlers_disconnect_by_func (contact,
+				G_CALLBACK (contact_alias_cb), NULL);
+		contact_search_remove (search, contact);
+
+		/* drops the roster's reference */
+		g_hash_table_iter_remove (&iter);
+	}
+}
+
+/* resolves the members added to @channel since we last looked at it; the
+ * members that haven't changed are already on the roster */
+static void
+sync_members (TpChannel *channel)
+{
+	const char *list = tp_channel_get_identifier (channel);
+	RosterSync *sync = g_hash_table_lookup (list_members, list);
+	GArray *added = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+	GArray *removed = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+	gboolean first = (sync == NULL);
+	guint unchanged;
+
+	if (first)
+	{
+		sync = roster_sync_new ();
+		g_hash_table_insert (list_members, g_strdup (list), sync);
+	}
+
+	unchanged = roster_sync_update (sync,
+			tp_channel_group_get_members (channel),
+			added, removed);
+
+	if (first && added->len <= CONTACTS_PER_REQUEST)
+	{
+		/* the whole list fits in one request */
+		get_members (channel);
+	}
+	else
+	{
+		g_print ("   %s contains %u members (%u new, %u removed)\n",
+				list, unchanged + added->len, added->len,
+				removed->len);
+
+		remove_members (removed);
+
+		/* a list seen again with nobody new has nothing to resolve */
+		if (added->len > 0)
+		{
+			resolve_members (channel, added);
+		}
+	}
+
+	g_array_free (added, TRUE);
+	g_array_free (removed, TRUE);
+}
+
+static void
+group_members_changed_cb (TpChannel	*channel,
+			  char		*message,
+			  GArray	*added,
+			  GArray	*removed,
+			  GArray	*local_pending,
+			  GArray	*remote_pending,
+			  guint		 actor,
+			  guint		 reason,
+			  gpointer	 user_data)
+{
+	sync_members (channel);
+}
+
+static void
+channel_ready (TpChannel	*channel,
+	       const GError	*in_error,
+	       gpointer		 user_data)
+{
+	const char *list = tp_channel_get_identifier (channel);
+
+	g_print (" > channel_ready (%s)\n", list);
+
+	/* a list can be announced both by the Channels property and by
+	 * NewChannels, only follow its changes once */
+	if (g_hash_table_lookup (list_members, list) == NULL)
+	{
+		g_signal_connect (channel, "group-members-changed",
+				G_CALLBACK (group_members_changed_cb), NULL);
+	}
+
+	sync_members (channel);
+}
+
 static void
 new_channels_cb (TpConnection		*conn,
                  const GPtrArray	*channels,
@@ -161,6 +610,16 @@ get_channels_cb (TpProxy	*proxy,
 	new_channels_cb (conn, channels, user_data, weak_obj);
 }
 
+static void
+print_presence (TpHandle			 handle,
+		TpConnectionPresenceType	 type,
+		const char			*status,
+		const char			*message,
+		gpointer			 user_data)
+{
+	g_print ("Contact handle %u -> %s - %s\n", handle, status, message);
+}
+
 static void
 presences_changed_cb (TpConnection	*conn,
                       GHashTable	*presence,
@@ -175,22 +634,77 @@ presences_changed_cb (TpConnection	*conn,
 	GHashTableIter iter;
 	gpointer key, value;
 
+	if (recorder != NULL)
+	{
+		presence_recorder_begin_batch (recorder);
+	}
+
 	g_hash_table_iter_init (&iter, presence);
 	while (g_hash_table_iter_next (&iter, &key, &value))
 	{
-		int contact = GPOINTER_TO_UINT (key);
+		TpHandle contact = GPOINTER_TO_UINT (key);
 		GValueArray *spresence = (GValueArray *) value;
 
+		guint type;
 		const char *status, *status_message;
 
 		tp_value_array_unpack (spresence, 3,
-				NULL,
+				&type,
 				&status,
 				&status_message);
 
-		g_print ("Contact handle %i -> %s - %s\n",
-				contact, status, status_message);
+		if (recorder != NULL)
+		{
+			presence_recorder_record (recorder, contact,
+					type, status, status_message);
+		}
+
+		presence_table_set (presences, contact,
+				type, status, status_message);
 	}
+
+	/* only the handles whose presence actually changed are printed */
+	presence_table_read_changed (presences, print_presence, NULL);
+}
+
+/* each line typed on stdin is a prefix to search the roster for */
+static gboolean
+search_input_cb (GIOChannel	*source,
+		 GIOCondition	 condition,
+		 gpointer	 user_data)
+{
+	TpContact *results[MAX_SEARCH_RESULTS];
+	char *line = NULL;
+	guint i, n;
+
+	if (g_io_channel_read_line (source, &line, NULL, NULL, NULL) !=
+			G_IO_STATUS_NORMAL)
+	{
+		/* EOF, stop watching */
+		return FALSE;
+	}
+
+	g_strchomp (line);
+
+	GTimer *timer = g_timer_new ();
+	n = contact_search_lookup (search, line, MAX_SEARCH_RESULTS, results);
+	g_timer_stop (timer);
+
+	g_print (" ? %s: %u matches in %.0f us (%u keys)\n", line, n,
+			g_timer_elapsed (timer, NULL) * G_USEC_PER_SEC,
+			contact_search_get_n_keys (search));
+
+	for (i = 0; i < n; i++)
+	{
+		g_print ("  %s (%s)\n",
+				tp_contact_get_alias (results[i]),
+				tp_contact_get_identifier (results[i]));
+	}
+
+	g_timer_destroy (timer);
+	g_free (line);
+
+	return TRUE;
 }
 
 static void
@@ -213,6 +727,22 @@ conn_ready (TpConnection	*conn,
 	}
 	g_strfreev (interfaces);
 
+	/* now the password has been read, stdin can be used for searching
+	 * the roster */
+	GIOChannel *input = g_io_channel_unix_new (STDIN_FILENO);
+	g_io_add_watch (input, G_IO_IN | G_IO_HUP, search_input_cb, NULL);
+	g_io_channel_unref (input);
+
+	/* track presence changes, if the connection supports presence */
+	if (tp_proxy_has_interface_by_id (conn,
+		TP_IFACE_QUARK_CONNECTION_INTERFACE_SIMPLE_PRESENCE))
+	{
+		tp_cli_connection_interface_simple_presence_connect_to_presences_changed (
+				conn, presences_changed_cb,
+				NULL, NULL, NULL, &error);
+		handle_error (error);
+	}
+
 	/* check if the Requests interface is available */
 	if (tp_proxy_has_interface_by_id (conn,
 		TP_IFACE_QUARK_CONNECTION_INTERFACE_REQUESTS))
@@ -272,6 +802,14 @@ status_changed_cb (TpConnection	*conn,
 	if (status == TP_CONNECTION_STATUS_DISCONNECTED)
 	{
 		g_print ("Disconnected\n");
+
+		/* remember the last presence we saw for next time, a partial
+		 * roster would make contacts look removed next time */
+		if (roster_lists_ready == ROSTER_LISTS_ALL)
+		{
+			save_snapshot ();
+		}
+
 		g_main_loop_quit (loop);
 	}
 	else if (status == TP_CONNECTION_STATUS_CONNECTED)
@@ -347,6 +885,49 @@ interrupt_cb (int signal)
 	tp_cli_connection_call_disconnect (conn, -1, NULL, NULL, NULL, NULL);
 }
 
+static void
+replay_done_cb (PresenceReplayer	*replayer,
+		guint			 n_events,
+		gdouble			 elapsed,
+		gpointer		 user_data)
+{
+	g_print (" > replayed %u presence changes in %.3f s (%.0f/s)\n",
+			n_events, elapsed,
+			elapsed > 0 ? n_events / elapsed : 0);
+
+	g_main_loop_quit (loop);
+}
+
+/* feeds a recorded log to presences_changed_cb instead of connecting;
+ * speed is a multiple of the recorded speed, 0 replays as fast as possible */
+static int
+replay (const char	*path,
+	gdouble		 speed)
+{
+	GError *error = NULL;
+	PresenceReplayer *replayer = presence_replayer_new (path, &error);
+
+	if (replayer == NULL)
+	{
+		g_error ("%s", error->message);
+	}
+
+	loop = g_main_loop_new (NULL, FALSE);
+	strings = string_pool_new ();
+	presences = presence_table_new (strings);
+
+	presence_replayer_start (replayer, speed,
+			presences_changed_cb, replay_done_cb, NULL);
+
+	g_main_loop_run (loop);
+
+	presence_replayer_free (replayer);
+	presence_table_free (presences);
+	string_pool_free (strings);
+
+	return 0;
+}
+
 int
 main (int argc, char **argv)
 {
@@ -354,15 +935,55 @@ main (int argc, char **argv)
 
 	g_type_init ();
 
-	if (argc != 2)
+	/* example <username> [--record LOG]
+	 * example --replay LOG [SPEED] */
+	if (argc >= 3 && strcmp (argv[1], "--replay") == 0)
+	{
+		return replay (argv[2],
+				argc > 3 ? g_ascii_strtod (argv[3], NULL) : 1);
+	}
+
+	if (argc != 2 && !(argc == 4 && strcmp (argv[2], "--record") == 0))
 	{
 		g_error ("Must provide username!");
 	}
 	char *username = argv[1];
 
+	if (argc == 4)
+	{
+		recorder = presence_recorder_new (argv[3], &error);
+		if (recorder == NULL)
+		{
+			g_error ("%s", error->message);
+		}
+	}
+
 	/* create a main loop */
 	loop = g_main_loop_new (NULL, FALSE);
 
+	/* show the roster from last time straight away, while we wait for the
+	 * connection */
+	account = username;
+	roster = g_hash_table_new_full (NULL, NULL, g_object_unref, NULL);
+	list_members = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify) roster_sync_free);
+	strings = string_pool_new ();
+	presences = presence_table_new (strings);
+	snapshot = roster_snapshot_load (account, &error);
+	if (snapshot != NULL)
+	{
+		show_snapshot ();
+	}
+	else
+	{
+		g_print (" > no cached roster: %s\n", error->message);
+		g_clear_error (&error);
+	}
+
+	coalescer = contact_coalescer_new (MAX_CONTACTS_PER_FLUSH,
+			contacts_flushed_cb, NULL);
+	search = contact_search_new ();
+
 	/* acquire a connection to the D-Bus daemon */
 	bus_daemon = tp_dbus_daemon_dup (&error);
 	if (bus_daemon == NULL)
@@ -387,6 +1008,18 @@ main (int argc, char **argv)
 
 	g_main_loop_run (loop);
 
+	if (recorder != NULL)
+	{
+		presence_recorder_free (recorder);
+	}
+
+	contact_coalescer_free (coalescer);
+	contact_search_free (search);
+	roster_snapshot_free (snapshot);
+	presence_table_free (presences);
+	string_pool_free (strings);
+	g_hash_table_destroy (roster);
+	g_hash_table_destroy (list_members);
 	g_object_unref (bus_daemon);
 
 	return 0;
@@ -0,0 +1,425 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "presence-log.h"
+
+/* The log is a PresenceLogHeader followed by a stream of PresenceLogRecords.
+ *
+ * Strings (status names and status messages) are only written once: the
+ * first time a string is seen, a PRESENCE_LOG_STRING record assigns it the
+ * next string id, and is followed by the string itself (length bytes, not
+ * NUL-terminated, padded with NULs to a multiple of 4 bytes so that the
+ * next record is aligned). Events refer to strings by id.
+ *
+ * The events from each PresencesChanged or presence-changed signal follow a
+ * PRESENCE_LOG_BATCH record, which the replayer uses to group them back into
+ * a single signal. Batches are timestamped with the number of microseconds
+ * since the previous batch.
+ *
+ * The log is written in host byte order. */
+#define PRESENCE_LOG_MAGIC	"TPPL"
+#define PRESENCE_LOG_VERSION	2
+
+enum
+{
+	PRESENCE_LOG_EVENT,
+	PRESENCE_LOG_STRING,
+	PRESENCE_LOG_BATCH
+};
+
+typedef struct
+{
+	char magic[4];
+	guint32 version;
+} PresenceLogHeader;
+
+typedef struct
+{
+	/* the handle of an event, the length of a string, or the µs since
+	 * the previous batch */
+	guint32 value;
+	guint32 status;		/* string ids of an event, or the id of a
+				 * string */
+	guint32 message;
+	guint8 type;
+	guint8 kind;
+	guint16 padding;
+} PresenceLogRecord;
+
+/* the padded length of a string of @len bytes in the log */
+#define PRESENCE_LOG_PAD(len) \
+	(((len) + sizeof (guint32) - 1) & ~(sizeof (guint32) - 1))
+
+struct _PresenceRecorder
+{
+	FILE *file;
+	GTimer *timer;
+	guint64 last;
+
+	/* string -> string id + 1 */
+	GHashTable *strings;
+};
+
+struct _PresenceReplayer
+{
+	GMappedFile *file;
+	const char *data;
+	gsize length;
+	gsize offset;
+
+	/* indexed by string id */
+	GPtrArray *strings;
+
+	gdouble speed;
+	tp_cli_connection_interface_simple_presence_signal_callback_presences_changed callback;
+	PresenceReplayDoneFunc done;
+	gpointer user_data;
+
+	GTimer *timer;
+	guint64 log_time;	/* µs into the log of the next batch */
+	guint n_events;
+	guint source_id;
+};
+
+PresenceRecorder *
+presence_recorder_new (const char	*path,
+		       GError		**error)
+{
+	PresenceLogHeader header = { PRESENCE_LOG_MAGIC, PRESENCE_LOG_VERSION };
+	FILE *file;
+
+	file = g_fopen (path, "wb");
+	if (file == NULL ||
+	    fwrite (&header, sizeof (header), 1, file) != 1)
+	{
+		g_set_error (error, G_FILE_ERROR,
+				g_file_error_from_errno (errno),
+				"Could not write %s: %s", path,
+				g_strerror (errno));
+
+		if (file != NULL)
+		{
+			fclose (file);
+		}
+
+		return NULL;
+	}
+
+	PresenceRecorder *self = g_slice_new0 (PresenceRecorder);
+
+	self->file = file;
+	self->timer = g_timer_new ();
+	self->strings = g_hash_table_new_full (g_str_hash, g_str_equal,
+			g_free, NULL);
+
+	return self;
+}
+
+void
+presence_recorder_free (PresenceRecorder *self)
+{
+	fclose (self->file);
+	g_timer_destroy (self->timer);
+	g_hash_table_destroy (self->strings);
+
+	g_slice_free (PresenceRecorder, self);
+}
+
+static guint32
+recorder_string_id (PresenceRecorder	*self,
+		    const char		*str)
+{
+	static const char padding[sizeof (guint32)] = { 0, };
+	guint id = GPOINTER_TO_UINT (g_hash_table_lookup (self->strings,
+				str));
+
+	if (id != 0)
+	{
+		return id - 1;
+	}
+
+	PresenceLogRecord record = { 0, };
+
+	id = g_hash_table_size (self->strings);
+
+	record.kind = PRESENCE_LOG_STRING;
+	record.status = id;
+	record.value = strlen (str);
+
+	fwrite (&record, sizeof (record), 1, self->file);
+	fwrite (str, record.value, 1, self->file);
+	fwrite (padding, PRESENCE_LOG_PAD (record.value) - record.value, 1,
+			self->file);
+
+	g_hash_table_insert (self->strings, g_strdup (str),
+			GUINT_TO_POINTER (id + 1));
+
+	return id;
+}
+
+/* starts a batch of events, which is replayed as a single signal; call once
+ * per signal, before recording the events it carries */
+void
+presence_recorder_begin_batch (PresenceRecorder *self)
+{
+	PresenceLogRecord record = { 0, };
+	guint64 now = g_timer_elapsed (self->timer, NULL) * G_USEC_PER_SEC;
+
+	record.kind = PRESENCE_LOG_BATCH;
+	record.value = MIN (now - self->last, G_MAXUINT32);
+
+	self->last = now;
+
+	/* stdio buffers the writes for us */
+	fwrite (&record, sizeof (record), 1, self->file);
+}
+
+void
+presence_recorder_record (PresenceRecorder		*self,
+			  TpHandle			 handle,
+			  TpConnectionPresenceType	 type,
+			  const char			*status,
+			  const char			*message)
+{
+	PresenceLogRecord record = { 0, };
+
+	record.kind = PRESENCE_LOG_EVENT;
+	record.value = handle;
+	record.status = recorder_string_id (self,
+			status != NULL ? status : "");
+	record.message = recorder_string_id (self,
+			message != NULL ? message : "");
+	record.type = type;
+
+	fwrite (&record, sizeof (record), 1, self->file);
+}
+
+PresenceReplayer *
+presence_replayer_new (const char	*path,
+		       GError		**error)
+{
+	GMappedFile *file;
+	const PresenceLogHeader *header;
+
+	file = g_mapped_file_new (path, FALSE, error);
+	if (file == NULL)
+	{
+		return NULL;
+	}
+
+	header = (const PresenceLogHeader *) g_mapped_file_get_contents (file);
+
+	if (g_mapped_file_get_length (file) < sizeof (PresenceLogHeader) ||
+	    memcmp (header->magic, PRESENCE_LOG_MAGIC, 4) != 0 ||
+	    header->version != PRESENCE_LOG_VERSION)
+	{
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+				"%s is not a presence log", path);
+		g_mapped_file_unref (file);
+		return NULL;
+	}
+
+	PresenceReplayer *self = g_slice_new0 (PresenceReplayer);
+
+	self->file = file;
+	self->data = g_mapped_file_get_contents (file);
+	self->length = g_mapped_file_get_length (file);
+	self->offset = sizeof (PresenceLogHeader);
+	self->strings = g_ptr_array_new_with_free_func (g_free);
+
+	return self;
+}
+
+void
+presence_replayer_free (PresenceReplayer *self)
+{
+	if (self->source_id != 0)
+	{
+		g_source_remove (self->source_id);
+	}
+
+	if (self->timer != NULL)
+	{
+		g_timer_destroy (self->timer);
+	}
+
+	g_ptr_array_free (self->strings, TRUE);
+	g_mapped_file_unref (self->file);
+
+	g_slice_free (PresenceReplayer, self);
+}
+
+/* reads string definitions up to the next event or batch, and returns it
+ * without consuming it, or NULL at the end of the log. Records are always at
+ * 4-byte aligned offsets, since strings are padded. */
+static const PresenceLogRecord *
+replayer_peek (PresenceReplayer *self)
+{
+	while (self->offset + sizeof (PresenceLogRecord) <= self->length)
+	{
+		const PresenceLogRecord *record = (const PresenceLogRecord *)
+			(self->data + self->offset);
+
+		if (record->kind == PRESENCE_LOG_EVENT ||
+		    record->kind == PRESENCE_LOG_BATCH)
+		{
+			return record;
+		}
+
+		if (record->kind != PRESENCE_LOG_STRING ||
+		    record->status != self->strings->len ||
+		    PRESENCE_LOG_PAD ((gsize) record->value) >
+				self->length - self->offset -
+				sizeof (PresenceLogRecord))
+		{
+			g_warning ("Presence log is corrupt at offset %"
+					G_GSIZE_FORMAT, self->offset);
+			self->offset = self->length;
+			return NULL;
+		}
+
+		self->offset += sizeof (PresenceLogRecord);
+		g_ptr_array_add (self->strings,
+				g_strndup (self->data + self->offset,
+					record->value));
+		self->offset += PRESENCE_LOG_PAD ((gsize) record->value);
+	}
+
+	return NULL;
+}
+
+static gboolean _replay_batch (gpointer user_data);
+
+static gboolean
+_replay_finish (gpointer user_data)
+{
+	PresenceReplayer *self = user_data;
+
+	self->source_id = 0;
+	g_timer_stop (self->timer);
+
+	if (self->done != NULL)
+	{
+		self->done (self, self->n_events,
+				g_timer_elapsed (self->timer, NULL),
+				self->user_data);
+	}
+
+	return FALSE;
+}
+
+/* consumes the marker starting the next batch and schedules the batch, or
+ * finishes the replay at the end of the log */
+static void
+replayer_schedule (PresenceReplayer *self)
+{
+	const PresenceLogRecord *record = replayer_peek (self);
+	gdouble due, now;
+
+	/* finish from the main loop even if the log is empty, so the done
+	 * callback can always quit it */
+	if (record == NULL)
+	{
+		self->source_id = g_idle_add (_replay_finish, self);
+		return;
+	}
+
+	/* events recorded without a batch marker are replayed as one batch,
+	 * straight away */
+	if (record->kind == PRESENCE_LOG_BATCH)
+	{
+		self->log_time += record->value;
+		self->offset += sizeof (PresenceLogRecord);
+	}
+
+	if (self->speed <= 0)
+	{
+		self->source_id = g_idle_add (_replay_batch, self);
+		return;
+	}
+
+	/* schedule against the total log time rather than each delta, so
+	 * rounding to milliseconds doesn't accumulate */
+	due = self->log_time / (self->speed * G_USEC_PER_SEC);
+	now = g_timer_elapsed (self->timer, NULL);
+
+	self->source_id = g_timeout_add (due > now ? (due - now) * 1000 : 0,
+			_replay_batch, self);
+}
+
+static gboolean
+_replay_batch (gpointer user_data)
+{
+	PresenceReplayer *self = user_data;
+	const PresenceLogRecord *record;
+	GHashTable *presences;
+
+	self->source_id = 0;
+
+	/* the same a{u(uss)} map PresencesChanged would give us */
+	presences = g_hash_table_new_full (NULL, NULL, NULL,
+			(GDestroyNotify) g_value_array_free);
+
+	/* the batch runs up to the next batch marker */
+	while ((record = replayer_peek (self)) != NULL &&
+	       record->kind == PRESENCE_LOG_EVENT)
+	{
+		if (record->status >= self->strings->len ||
+		    record->message >= self->strings->len)
+		{
+			g_warning ("Presence log refers to unknown string at "
+					"offset %" G_GSIZE_FORMAT,
+					self->offset);
+			self->offset = self->length;
+			break;
+		}
+
+		g_hash_table_insert (presences,
+				GUINT_TO_POINTER (record->value),
+				tp_value_array_build (3,
+					G_TYPE_UINT, (guint) record->type,
+					G_TYPE_STRING, g_ptr_array_index (
+						self->strings, record->status),
+					G_TYPE_STRING, g_ptr_array_index (
+						self->strings, record->message),
+					G_TYPE_INVALID));
+
+		self->offset += sizeof (PresenceLogRecord);
+		self->n_events++;
+	}
+
+	if (g_hash_table_size (presences) > 0)
+	{
+		self->callback (NULL, presences, self->user_data, NULL);
+	}
+
+	g_hash_table_destroy (presences);
+
+	replayer_schedule (self);
+
+	return FALSE;
+}
+
+/* replays the log, calling @callback once for each batch that was recorded,
+ * with a NULL connection; @speed is a multiplier of the original speed, or 0 to
+ * replay as fast as possible */
+void
+presence_replayer_start (PresenceReplayer	*self,
+	gdouble			 speed,
+	tp_cli_connection_interface_simple_presence_signal_callback_presences_changed callback,
+	PresenceReplayDoneFunc	 done,
+	gpointer		 user_data)
+{
+	g_return_if_fail (self->timer == NULL);
+
+	self->speed = speed;
+	self->callback = callback;
+	self->done = done;
+	self->user_data = user_data;
+	self->timer = g_timer_new ();
+
+	replayer_schedule (self);
+}
@@ -0,0 +1,46 @@
+#ifndef __PRESENCE_LOG_H__
+#define __PRESENCE_LOG_H__
+
+#include <glib.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+/* A PresenceRecorder writes presence changes to a compact binary log as they
+ * happen, in batches of one per signal. A PresenceReplayer reads the log
+ * back and feeds each batch to a PresencesChanged handler, as though it came
+ * from a connection (the TpConnection passed is NULL), either at the original
+ * speed, faster, or as fast as possible. This makes it possible to benchmark
+ * presence handling against a real presence storm without needing the
+ * storm. */
+typedef struct _PresenceRecorder PresenceRecorder;
+typedef struct _PresenceReplayer PresenceReplayer;
+
+typedef void (* PresenceReplayDoneFunc) (PresenceReplayer	*replayer,
+					 guint			 n_events,
+					 gdouble		 elapsed,
+					 gpointer		 user_data);
+
+PresenceRecorder *presence_recorder_new (const char	*path,
+					 GError		**error);
+void presence_recorder_free (PresenceRecorder *self);
+void presence_recorder_begin_batch (PresenceRecorder *self);
+void presence_recorder_record (PresenceRecorder		*self,
+			       TpHandle			 handle,
+			       TpConnectionPresenceType	 type,
+			       const char		*status,
+			       const char		*message);
+
+PresenceReplayer *presence_replayer_new (const char	*path,
+					 GError		**error);
+void presence_replayer_free (PresenceReplayer *self);
+void presence_replayer_start (PresenceReplayer		*self,
+	gdouble			 speed,
+	tp_cli_connection_interface_simple_presence_signal_callback_presences_changed callback,
+	PresenceReplayDoneFunc	 done,
+	gpointer		 user_data);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,212 @@
+#include <string.h>
+
+#include "presence-table.h"
+
+/* Rather than keeping a struct per contact, the table keeps one array per
+ * field, each indexed by handle. Handles are allocated densely by the
+ * connection manager, so this wastes little space, and scanning a single
+ * field (e.g. counting who is available) only touches that field's array.
+ *
+ *  - types: the TpConnectionPresenceType, one byte each
+ *  - statuses: the status, as an id in the string pool
+ *  - messages: the status message, as an id in the string pool
+ *
+ * Most contacts share a status and many share a message (most commonly the
+ * empty one), so storing pool ids rather than copies keeps the table small.
+ *
+ * A handle whose type is TP_CONNECTION_PRESENCE_TYPE_UNSET has no presence
+ * stored. */
+#define BITS_PER_WORD	(sizeof (gulong) * 8)
+
+struct _PresenceTable
+{
+	StringPool *pool;
+
+	GArray *types;		/* of guint8 */
+	GArray *statuses;	/* of guint32 */
+	GArray *messages;	/* of guint32 */
+
+	/* bit n is set if handle n changed since the last read */
+	GArray *changed;	/* of gulong */
+};
+
+/* @pool is borrowed, and must outlive the table */
+PresenceTable *
+presence_table_new (StringPool *pool)
+{
+	PresenceTable *self = g_slice_new0 (PresenceTable);
+
+	self->pool = pool;
+	self->types = g_array_new (FALSE, TRUE, sizeof (guint8));
+	self->statuses = g_array_new (FALSE, TRUE, sizeof (guint32));
+	self->messages = g_array_new (FALSE, TRUE, sizeof (guint32));
+	self->changed = g_array_new (FALSE, TRUE, sizeof (gulong));
+
+	return self;
+}
+
+void
+presence_table_free (PresenceTable *self)
+{
+	guint h;
+
+	for (h = 0; h < self->types->len; h++)
+	{
+		string_pool_unref (self->pool,
+				g_array_index (self->statuses, guint32, h));
+		string_pool_unref (self->pool,
+				g_array_index (self->messages, guint32, h));
+	}
+
+	g_array_free (self->types, TRUE);
+	g_array_free (self->statuses, TRUE);
+	g_array_free (self->messages, TRUE);
+	g_array_free (self->changed, TRUE);
+
+	g_slice_free (PresenceTable, self);
+}
+
+static void
+ensure_handle (PresenceTable	*self,
+	       TpHandle		 handle)
+{
+	if (handle < self->types->len)
+	{
+		return;
+	}
+
+	/* the arrays are created with clear_ set, so new elements are unset */
+	g_array_set_size (self->types, handle + 1);
+	g_array_set_size (self->statuses, handle + 1);
+	g_array_set_size (self->messages, handle + 1);
+	g_array_set_size (self->changed, handle / BITS_PER_WORD + 1);
+}
+
+void
+presence_table_set (PresenceTable		*self,
+		    TpHandle			 handle,
+		    TpConnectionPresenceType	 type,
+		    const char			*status,
+		    const char			*message)
+{
+	g_return_if_fail (handle != 0);
+	g_return_if_fail (type < NUM_TP_CONNECTION_PRESENCE_TYPES);
+
+	if (message == NULL)
+	{
+		message = "";
+	}
+
+	ensure_handle (self, handle);
+
+	guint8 *t = &g_array_index (self->types, guint8, handle);
+	guint32 *s = &g_array_index (self->statuses, guint32, handle);
+	guint32 *m = &g_array_index (self->messages, guint32, handle);
+
+	if (*t == type &&
+	    !strcmp (string_pool_get (self->pool, *s),
+		    status != NULL ? status : "") &&
+	    !strcmp (string_pool_get (self->pool, *m), message))
+	{
+		/* nothing changed, don't mark the handle */
+		return;
+	}
+
+	/* take the new references before dropping the old ones, so a string
+	 * shared by both isn't freed in between */
+	guint32 status_id = string_pool_ref (self->pool, status);
+	guint32 message_id = string_pool_ref (self->pool, message);
+
+	string_pool_unref (self->pool, *s);
+	string_pool_unref (self->pool, *m);
+
+	*t = type;
+	*s = status_id;
+	*m = message_id;
+
+	g_array_index (self->changed, gulong, handle / BITS_PER_WORD) |=
+		1UL << (handle % BITS_PER_WORD);
+}
+
+/* the returned strings are owned by the string pool, and are valid until
+ * the next call to presence_table_set() for @handle */
+gboolean
+presence_table_get (PresenceTable		*self,
+		    TpHandle			 handle,
+		    TpConnectionPresenceType	*type,
+		    const char			**status,
+		    const char			**message)
+{
+	if (handle >= self->types->len ||
+	    g_array_index (self->types, guint8, handle) ==
+			TP_CONNECTION_PRESENCE_TYPE_UNSET)
+	{
+		return FALSE;
+	}
+
+	if (type != NULL)
+	{
+		*type = g_array_index (self->types, guint8, handle);
+	}
+
+	if (status != NULL)
+	{
+		*status = string_pool_get (self->pool,
+				g_array_index (self->statuses, guint32,
+					handle));
+	}
+
+	if (message != NULL)
+	{
+		*message = string_pool_get (self->pool,
+				g_array_index (self->messages, guint32,
+					handle));
+	}
+
+	return TRUE;
+}
+
+/* calls @func for each handle whose presence changed since the last call,
+ * returns the number of handles visited */
+guint
+presence_table_read_changed (PresenceTable	*self,
+			     PresenceTableFunc	 func,
+			     gpointer		 user_data)
+{
+	guint w, n = 0;
+
+	for (w = 0; w < self->changed->len; w++)
+	{
+		gulong word = g_array_index (self->changed, gulong, w);
+		gint bit = -1;
+
+		/* whole words of unchanged handles are skipped at once */
+		if (word == 0)
+		{
+			continue;
+		}
+
+		/* clear the word first, in case func sets a presence */
+		g_array_index (self->changed, gulong, w) = 0;
+
+		while ((bit = g_bit_nth_lsf (word, bit)) != -1)
+		{
+			TpHandle handle = w * BITS_PER_WORD + bit;
+			TpConnectionPresenceType type;
+			const char *status, *message;
+
+			if (!presence_table_get (self, handle,
+						&type, &status, &message))
+			{
+				/* the presence was reset to unset */
+				type = TP_CONNECTION_PRESENCE_TYPE_UNSET;
+				status = message = "";
+			}
+
+			func (handle, type, status, message, user_data);
+			n++;
+		}
+	}
+
+	return n;
+}
@@ -0,0 +1,43 @@
+#ifndef __PRESENCE_TABLE_H__
+#define __PRESENCE_TABLE_H__
+
+#include <glib.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "string-pool.h"
+
+G_BEGIN_DECLS
+
+/* A PresenceTable holds the current presence of every contact on a
+ * connection, indexed by handle. It also remembers which handles changed
+ * since the last time they were read. */
+typedef struct _PresenceTable PresenceTable;
+
+typedef void (* PresenceTableFunc) (TpHandle			 handle,
+				    TpConnectionPresenceType	 type,
+				    const char			*status,
+				    const char			*message,
+				    gpointer			 user_data);
+
+PresenceTable *presence_table_new (StringPool *pool);
+void presence_table_free (PresenceTable *self);
+
+void presence_table_set (PresenceTable			*self,
+			 TpHandle			 handle,
+			 TpConnectionPresenceType	 type,
+			 const char			*status,
+			 const char			*message);
+gboolean presence_table_get (PresenceTable		*self,
+			     TpHandle			 handle,
+			     TpConnectionPresenceType	*type,
+			     const char			**status,
+			     const char			**message);
+
+guint presence_table_read_changed (PresenceTable	*self,
+				   PresenceTableFunc	 func,
+				   gpointer		 user_data);
+
+G_END_DECLS
+
+#endif
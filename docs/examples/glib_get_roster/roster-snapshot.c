@@ -0,0 +1,425 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "roster-snapshot.h"
+
+/* The snapshot file is laid out as:
+ *  - a SnapshotHeader
+ *  - n_entries SnapshotRecords, sorted by identifier
+ *  - strings_size bytes of NUL-terminated strings, referenced by offset from
+ *    the records. Offset 0 is always the empty string.
+ *
+ * The file is written in host byte order, it is a cache and not meant to be
+ * portable. A snapshot written on a different architecture will fail the
+ * magic check and be ignored. */
+#define SNAPSHOT_MAGIC		0x53525054 /* TPRS */
+#define SNAPSHOT_VERSION	1
+
+typedef struct
+{
+	guint32 magic;
+	guint32 version;
+	guint32 n_entries;
+	guint32 strings_size;
+} SnapshotHeader;
+
+typedef struct
+{
+	guint32 identifier;
+	guint32 alias;
+	guint32 presence_type;
+	guint32 presence_status;
+	guint32 presence_message;
+	guint32 avatar_token;
+} SnapshotRecord;
+
+struct _RosterSnapshot
+{
+	GMappedFile *file;
+
+	guint n_entries;
+	const SnapshotRecord *records;
+	const char *strings;
+};
+
+static char *
+snapshot_path (const char *account)
+{
+	char *escaped = tp_escape_as_identifier (account);
+	char *path = g_build_filename (g_get_user_cache_dir (),
+			"telepathy-doc", "roster", escaped, NULL);
+
+	g_free (escaped);
+
+	return path;
+}
+
+static gboolean
+snapshot_validate (const char	*contents,
+		   gsize	 length)
+{
+	const SnapshotHeader *header = (const SnapshotHeader *) contents;
+	const SnapshotRecord *records;
+	const char *strings;
+	guint i;
+
+	if (length < sizeof (SnapshotHeader) ||
+	    header->magic != SNAPSHOT_MAGIC ||
+	    header->version != SNAPSHOT_VERSION ||
+	    header->strings_size == 0)
+	{
+		return FALSE;
+	}
+
+	if (header->n_entries > (length - sizeof (SnapshotHeader)) /
+				sizeof (SnapshotRecord) ||
+	    length != sizeof (SnapshotHeader) +
+		      header->n_entries * sizeof (SnapshotRecord) +
+		      header->strings_size)
+	{
+		return FALSE;
+	}
+
+	records = (const SnapshotRecord *) (header + 1);
+	strings = (const char *) (records + header->n_entries);
+
+	/* checking every offset once here means the accessors never have to */
+	if (strings[0] != '\0' || strings[header->strings_size - 1] != '\0')
+	{
+		return FALSE;
+	}
+
+	for (i = 0; i < header->n_entries; i++)
+	{
+		const SnapshotRecord *r = records + i;
+
+		if (r->identifier >= header->strings_size ||
+		    r->alias >= header->strings_size ||
+		    r->presence_status >= header->strings_size ||
+		    r->presence_message >= header->strings_size ||
+		    r->avatar_token >= header->strings_size ||
+		    r->presence_type >= NUM_TP_CONNECTION_PRESENCE_TYPES)
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+RosterSnapshot *
+roster_snapshot_load (const char	*account,
+		      GError		**error)
+{
+	char *path = snapshot_path (account);
+	GMappedFile *file;
+
+	file = g_mapped_file_new (path, FALSE, error);
+	if (file == NULL)
+	{
+		g_free (path);
+		return NULL;
+	}
+
+	const char *contents = g_mapped_file_get_contents (file);
+	gsize length = g_mapped_file_get_length (file);
+
+	if (!snapshot_validate (contents, length))
+	{
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+				"Roster snapshot %s is corrupt", path);
+		g_mapped_file_unref (file);
+		g_free (path);
+		return NULL;
+	}
+
+	g_free (path);
+
+	const SnapshotHeader *header = (const SnapshotHeader *) contents;
+	RosterSnapshot *self = g_slice_new0 (RosterSnapshot);
+
+	self->file = file;
+	self->n_entries = header->n_entries;
+	self->records = (const SnapshotRecord *) (header + 1);
+	self->strings = (const char *) (self->records + self->n_entries);
+
+	return self;
+}
+
+void
+roster_snapshot_free (RosterSnapshot *self)
+{
+	if (self == NULL)
+	{
+		return;
+	}
+
+	g_mapped_file_unref (self->file);
+	g_slice_free (RosterSnapshot, self);
+}
+
+guint
+roster_snapshot_get_n_entries (RosterSnapshot *self)
+{
+	return self->n_entries;
+}
+
+void
+roster_snapshot_get_entry (RosterSnapshot	*self,
+			   guint		 i,
+			   RosterSnapshotEntry	*entry)
+{
+	g_return_if_fail (i < self->n_entries);
+
+	const SnapshotRecord *r = self->records + i;
+
+	entry->identifier = self->strings + r->identifier;
+	entry->alias = self->strings + r->alias;
+	entry->presence_type = r->presence_type;
+	entry->presence_status = self->strings + r->presence_status;
+	entry->presence_message = self->strings + r->presence_message;
+	entry->avatar_token = self->strings + r->avatar_token;
+}
+
+gboolean
+roster_snapshot_lookup (RosterSnapshot		*self,
+			const char		*identifier,
+			RosterSnapshotEntry	*entry)
+{
+	guint lo = 0, hi = self->n_entries;
+
+	/* records are sorted by identifier */
+	while (lo < hi)
+	{
+		guint mid = lo + (hi - lo) / 2;
+		int cmp = strcmp (identifier,
+				self->strings + self->records[mid].identifier);
+
+		if (cmp == 0)
+		{
+			roster_snapshot_get_entry (self, mid, entry);
+			return TRUE;
+		}
+		else if (cmp < 0)
+		{
+			hi = mid;
+		}
+		else
+		{
+			lo = mid + 1;
+		}
+	}
+
+	return FALSE;
+}
+
+static const char *
+nonnull (const char *str)
+{
+	return str != NULL ? str : "";
+}
+
+static int
+contact_cmp (const void *a,
+	     const void *b)
+{
+	TpContact *ca = *(TpContact **) a;
+	TpContact *cb = *(TpContact **) b;
+
+	return strcmp (tp_contact_get_identifier (ca),
+			tp_contact_get_identifier (cb));
+}
+
+static TpContact **
+sort_contacts (TpContact * const	*contacts,
+	       guint			 n_contacts)
+{
+	TpContact **sorted = g_memdup (contacts,
+			n_contacts * sizeof (TpContact *));
+
+	qsort (sorted, n_contacts, sizeof (TpContact *), contact_cmp);
+
+	return sorted;
+}
+
+static gboolean
+entry_matches_contact (const RosterSnapshotEntry	*entry,
+		       TpContact			*contact)
+{
+	return entry->presence_type == tp_contact_get_presence_type (contact) &&
+	       !strcmp (entry->alias,
+			nonnull (tp_contact_get_alias (contact))) &&
+	       !strcmp (entry->presence_status,
+			nonnull (tp_contact_get_presence_status (contact))) &&
+	       !strcmp (entry->presence_message,
+			nonnull (tp_contact_get_presence_message (contact))) &&
+	       !strcmp (entry->avatar_token,
+			nonnull (tp_contact_get_avatar_token (contact)));
+}
+
+void
+roster_snapshot_diff (RosterSnapshot		*self,
+		      TpContact * const		*contacts,
+		      guint			 n_contacts,
+		      RosterSnapshotDiffFunc	 func,
+		      gpointer			 user_data)
+{
+	TpContact **sorted = sort_contacts (contacts, n_contacts);
+	guint n_entries = self != NULL ? self->n_entries : 0;
+	guint i = 0, j = 0;
+
+	/* both lists are sorted by identifier, so a single merge pass finds
+	 * everything that was added, removed or changed */
+	while (i < n_entries || j < n_contacts)
+	{
+		RosterSnapshotEntry entry;
+		int cmp;
+
+		if (i < n_entries)
+		{
+			roster_snapshot_get_entry (self, i, &entry);
+		}
+
+		if (i == n_entries)
+		{
+			cmp = 1;
+		}
+		else if (j == n_contacts)
+		{
+			cmp = -1;
+		}
+		else
+		{
+			cmp = strcmp (entry.identifier,
+				tp_contact_get_identifier (sorted[j]));
+		}
+
+		if (cmp < 0)
+		{
+			func (ROSTER_SNAPSHOT_REMOVED, &entry, NULL, user_data);
+			i++;
+		}
+		else if (cmp > 0)
+		{
+			func (ROSTER_SNAPSHOT_ADDED, NULL, sorted[j], user_data);
+			j++;
+		}
+		else
+		{
+			if (!entry_matches_contact (&entry, sorted[j]))
+			{
+				func (ROSTER_SNAPSHOT_CHANGED, &entry,
+						sorted[j], user_data);
+			}
+			i++;
+			j++;
+		}
+	}
+
+	g_free (sorted);
+}
+
+static guint32
+add_string (GByteArray	*strings,
+	    GHashTable	*offsets,
+	    const char	*str)
+{
+	gpointer offset;
+
+	if (str == NULL || *str == '\0')
+	{
+		return 0;
+	}
+
+	/* status strings and avatar tokens repeat a lot, only store them once */
+	if (g_hash_table_lookup_extended (offsets, str, NULL, &offset))
+	{
+		return GPOINTER_TO_UINT (offset);
+	}
+
+	guint32 off = strings->len;
+
+	g_byte_array_append (strings, (const guint8 *) str, strlen (str) + 1);
+	g_hash_table_insert (offsets, (gpointer) str, GUINT_TO_POINTER (off));
+
+	return off;
+}
+
+gboolean
+roster_snapshot_save (const char		*account,
+		      TpContact * const		*contacts,
+		      guint			 n_contacts,
+		      GError			**error)
+{
+	TpContact **sorted = sort_contacts (contacts, n_contacts);
+	GByteArray *strings = g_byte_array_new ();
+	GHashTable *offsets = g_hash_table_new (g_str_hash, g_str_equal);
+	SnapshotRecord *records = g_new0 (SnapshotRecord, n_contacts);
+	SnapshotHeader header = { 0 };
+	guint i;
+
+	/* offset 0 is the empty string */
+	g_byte_array_append (strings, (const guint8 *) "", 1);
+
+	for (i = 0; i < n_contacts; i++)
+	{
+		TpContact *contact = sorted[i];
+		SnapshotRecord *r = records + i;
+
+		r->identifier = add_string (strings, offsets,
+				tp_contact_get_identifier (contact));
+		r->alias = add_string (strings, offsets,
+				tp_contact_get_alias (contact));
+		r->presence_type = tp_contact_get_presence_type (contact);
+		r->presence_status = add_string (strings, offsets,
+				tp_contact_get_presence_status (contact));
+		r->presence_message = add_string (strings, offsets,
+				tp_contact_get_presence_message (contact));
+		r->avatar_token = add_string (strings, offsets,
+				tp_contact_get_avatar_token (contact));
+	}
+
+	header.magic = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	header.n_entries = n_contacts;
+	header.strings_size = strings->len;
+
+	GByteArray *data = g_byte_array_sized_new (sizeof (header) +
+			n_contacts * sizeof (SnapshotRecord) + strings->len);
+	g_byte_array_append (data, (const guint8 *) &header, sizeof (header));
+	g_byte_array_append (data, (const guint8 *) records,
+			n_contacts * sizeof (SnapshotRecord));
+	g_byte_array_append (data, strings->data, strings->len);
+
+	char *path = snapshot_path (account);
+	char *dir = g_path_get_dirname (path);
+	gboolean ret = FALSE;
+
+	if (g_mkdir_with_parents (dir, 0700) != 0)
+	{
+		g_set_error (error, G_FILE_ERROR,
+				g_file_error_from_errno (errno),
+				"Could not create %s", dir);
+	}
+	else
+	{
+		/* g_file_set_contents() writes to a temporary file and renames
+		 * it over the old snapshot, so a reader that has the old one
+		 * mapped is unaffected */
+		ret = g_file_set_contents (path, (const char *) data->data,
+				data->len, error);
+	}
+
+	g_free (dir);
+	g_free (path);
+	g_byte_array_free (data, TRUE);
+	g_hash_table_destroy (offsets);
+	g_byte_array_free (strings, TRUE);
+	g_free (records);
+	g_free (sorted);
+
+	return ret;
+}
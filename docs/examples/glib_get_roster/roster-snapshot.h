@@ -0,0 +1,66 @@
+#ifndef __ROSTER_SNAPSHOT_H__
+#define __ROSTER_SNAPSHOT_H__
+
+#include <glib.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+/* A RosterSnapshot is the roster of an account as it was last seen, stored on
+ * disk so that it can be memory-mapped and shown straight away on startup,
+ * before the connection's contact lists are available. */
+typedef struct _RosterSnapshot RosterSnapshot;
+
+/* the strings in an entry point into the mapped snapshot, and are only valid
+ * for as long as the snapshot is; unset strings are "" rather than NULL */
+typedef struct
+{
+	const char *identifier;
+	const char *alias;
+	TpConnectionPresenceType presence_type;
+	const char *presence_status;
+	const char *presence_message;
+	const char *avatar_token;
+} RosterSnapshotEntry;
+
+typedef enum
+{
+	ROSTER_SNAPSHOT_ADDED,
+	ROSTER_SNAPSHOT_CHANGED,
+	ROSTER_SNAPSHOT_REMOVED
+} RosterSnapshotChange;
+
+/* @entry is NULL for ROSTER_SNAPSHOT_ADDED, @contact is NULL for
+ * ROSTER_SNAPSHOT_REMOVED */
+typedef void (* RosterSnapshotDiffFunc) (RosterSnapshotChange	 change,
+					 const RosterSnapshotEntry *entry,
+					 TpContact		*contact,
+					 gpointer		 user_data);
+
+RosterSnapshot *roster_snapshot_load (const char	*account,
+				      GError		**error);
+void roster_snapshot_free (RosterSnapshot *self);
+
+guint roster_snapshot_get_n_entries (RosterSnapshot *self);
+void roster_snapshot_get_entry (RosterSnapshot		*self,
+				guint			 i,
+				RosterSnapshotEntry	*entry);
+gboolean roster_snapshot_lookup (RosterSnapshot		*self,
+				 const char		*identifier,
+				 RosterSnapshotEntry	*entry);
+
+void roster_snapshot_diff (RosterSnapshot		*self,
+			   TpContact * const		*contacts,
+			   guint			 n_contacts,
+			   RosterSnapshotDiffFunc	 func,
+			   gpointer			 user_data);
+
+gboolean roster_snapshot_save (const char		*account,
+			       TpContact * const	*contacts,
+			       guint			 n_contacts,
+			       GError			**error);
+
+G_END_DECLS
+
+#endif
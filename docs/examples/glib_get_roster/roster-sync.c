@@ -0,0 +1,169 @@
+#include <string.h>
+
+#include "roster-sync.h"
+
+/* runs of unchanged handles are skipped this many at a time with memcmp(),
+ * which the C library vectorizes, rather than one comparison per handle */
+#define SKIP_BLOCK 16
+
+struct _RosterSync
+{
+	/* the members last time the list was seen, sorted */
+	GArray *members;
+};
+
+RosterSync *
+roster_sync_new (void)
+{
+	RosterSync *self = g_slice_new0 (RosterSync);
+
+	self->members = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+
+	return self;
+}
+
+void
+roster_sync_free (RosterSync *self)
+{
+	g_array_free (self->members, TRUE);
+
+	g_slice_free (RosterSync, self);
+}
+
+/* appends the handles in @new_handles but not @old_handles to @added, and
+ * those in @old_handles but not @new_handles to @removed; both inputs must
+ * be sorted, and so are the outputs.
+ *
+ * Either output may be NULL if it isn't wanted. */
+void
+roster_sync_diff (const TpHandle	*old_handles,
+		  guint			 n_old,
+		  const TpHandle	*new_handles,
+		  guint			 n_new,
+		  GArray		*added,
+		  GArray		*removed)
+{
+	guint i = 0, j = 0;
+
+	while (i < n_old && j < n_new)
+	{
+		if (i + SKIP_BLOCK <= n_old && j + SKIP_BLOCK <= n_new &&
+		    memcmp (old_handles + i, new_handles + j,
+			    SKIP_BLOCK * sizeof (TpHandle)) == 0)
+		{
+			i += SKIP_BLOCK;
+			j += SKIP_BLOCK;
+		}
+		else if (old_handles[i] == new_handles[j])
+		{
+			i++;
+			j++;
+		}
+		else if (old_handles[i] < new_handles[j])
+		{
+			if (removed != NULL)
+			{
+				g_array_append_val (removed, old_handles[i]);
+			}
+			i++;
+		}
+		else
+		{
+			if (added != NULL)
+			{
+				g_array_append_val (added, new_handles[j]);
+			}
+			j++;
+		}
+	}
+
+	if (removed != NULL && i < n_old)
+	{
+		g_array_append_vals (removed, old_handles + i, n_old - i);
+	}
+
+	if (added != NULL && j < n_new)
+	{
+		g_array_append_vals (added, new_handles + j, n_new - j);
+	}
+}
+
+/* replaces the remembered members with @members, appending the handles
+ * that were added and removed since the last update to @added and @removed.
+ * Returns the number of members that didn't change. */
+guint
+roster_sync_update (RosterSync		*self,
+		    const TpIntSet	*members,
+		    GArray		*added,
+		    GArray		*removed)
+{
+	/* an intset is a bitfield, so its array is already sorted */
+	GArray *handles = tp_intset_to_array (members);
+	guint n_removed = removed != NULL ? removed->len : 0;
+	guint unchanged;
+
+	if (handles->len == self->members->len &&
+	    memcmp (handles->data, self->members->data,
+		    handles->len * sizeof (TpHandle)) == 0)
+	{
+		/* the common case when a list is seen again */
+		unchanged = handles->len;
+	}
+	else
+	{
+		GArray *delta = removed != NULL ? removed :
+			g_array_new (FALSE, FALSE, sizeof (TpHandle));
+
+		roster_sync_diff (
+				(const TpHandle *) self->members->data,
+				self->members->len,
+				(const TpHandle *) handles->data,
+				handles->len,
+				added, delta);
+
+		unchanged = self->members->len - (delta->len - n_removed);
+
+		if (delta != removed)
+		{
+			g_array_free (delta, TRUE);
+		}
+	}
+
+	g_array_free (self->members, TRUE);
+	self->members = handles;
+
+	return unchanged;
+}
+
+/* returns the members as of the last update, as a sorted array of
+ * TpHandle owned by @self */
+const GArray *
+roster_sync_get_members (RosterSync *self)
+{
+	return self->members;
+}
+
+/* whether @handle was a member as of the last update */
+gboolean
+roster_sync_contains (RosterSync	*self,
+		      TpHandle		 handle)
+{
+	const TpHandle *members = (const TpHandle *) self->members->data;
+	guint lo = 0, hi = self->members->len;
+
+	while (lo < hi)
+	{
+		guint mid = lo + (hi - lo) / 2;
+
+		if (members[mid] < handle)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo < self->members->len && members[lo] == handle;
+}
@@ -0,0 +1,36 @@
+#ifndef __ROSTER_SYNC_H__
+#define __ROSTER_SYNC_H__
+
+#include <glib.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+/* A RosterSync remembers the members of a contact list as a sorted array of
+ * handles, so that when the list is seen again only the members that were
+ * added or removed since need to be dealt with. */
+typedef struct _RosterSync RosterSync;
+
+RosterSync *roster_sync_new (void);
+void roster_sync_free (RosterSync *self);
+
+guint roster_sync_update (RosterSync		*self,
+			  const TpIntSet	*members,
+			  GArray		*added,
+			  GArray		*removed);
+
+const GArray *roster_sync_get_members (RosterSync *self);
+gboolean roster_sync_contains (RosterSync	*self,
+			       TpHandle		 handle);
+
+void roster_sync_diff (const TpHandle	*old_handles,
+		       guint		 n_old,
+		       const TpHandle	*new_handles,
+		       guint		 n_new,
+		       GArray		*added,
+		       GArray		*removed);
+
+G_END_DECLS
+
+#endif
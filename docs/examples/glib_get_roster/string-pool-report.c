@@ -0,0 +1,256 @@
+/* Compares the memory used to hold the strings of a synthetic roster when
+ * every contact keeps its own copies against holding them in a StringPool.
+ * Both figures are measured, as the growth of the heap while each version
+ * of the roster is built, so they include the allocator's overhead and the
+ * pool's own bookkeeping.
+ *
+ * Usage: string-pool-report [n-contacts]
+ */
+#include <stdlib.h>
+#include <string.h>
+
+/* mallinfo2() is a glibc extension; elsewhere the heap figures are reported
+ * as unavailable */
+#if defined (__GLIBC__)
+# include <malloc.h>
+# if __GLIBC_PREREQ (2, 33)
+#  define HAVE_MALLINFO2 1
+# endif
+#endif
+
+#include <glib.h>
+
+#include "string-pool.h"
+
+#define DEFAULT_N_CONTACTS 50000
+#define MAX_GROUPS_PER_CONTACT 3
+
+static const char *statuses[] = {
+	"available", "away", "xa", "dnd", "offline"
+};
+
+static const char *messages[] = {
+	"", "", "", "", "", "",
+	"At lunch", "In a meeting", "Working from home", "On holiday",
+	"Back soon", "Busy", "Travelling", "Do not disturb"
+};
+
+static const char *groups[] = {
+	"Friends", "Family", "Work", "Colleagues", "University", "School",
+	"Football", "Neighbours", "Book Club", "Band", "Gym", "Old Friends"
+};
+
+static const char *first_names[] = {
+	"Alex", "Sam", "Jo", "Charlie", "Robin", "Kim", "Lee", "Max",
+	"Pat", "Chris", "Jamie", "Morgan", "Taylor", "Jordan", "Casey", "Drew"
+};
+
+/* a contact's strings, as a contact would normally hold them: each in its
+ * own allocation */
+typedef struct
+{
+	char *identifier;
+	char *alias;
+	char *status;
+	char *message;
+	char *groups[MAX_GROUPS_PER_CONTACT];
+	guint n_groups;
+} CopiedContact;
+
+typedef struct
+{
+	guint32 identifier;
+	guint32 alias;
+	guint32 status;
+	guint32 message;
+	guint32 groups[MAX_GROUPS_PER_CONTACT];
+	guint n_groups;
+} PooledContact;
+
+/* the number of bytes currently allocated from the heap, including
+ * allocations large enough to have been mmap()ed, or 0 where that can't be
+ * measured */
+static gsize
+heap_in_use (void)
+{
+#ifdef HAVE_MALLINFO2
+	struct mallinfo2 info = mallinfo2 ();
+
+	return info.uordblks + info.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+/* how much the heap grew since @start; the heap can also shrink meanwhile,
+ * as freed memory is handed back, which counts as no growth */
+static gsize
+heap_growth (gsize start)
+{
+	gsize now = heap_in_use ();
+
+	return now > start ? now - start : 0;
+}
+
+/* generates the strings of contact @i into @c; the roster is generated from
+ * a fixed seed, so every run, and both versions of the roster, see the same
+ * contacts */
+static void
+generate_contact (GRand		*rand,
+		  guint		 i,
+		  CopiedContact	*c)
+{
+	guint j;
+
+	c->identifier = g_strdup_printf ("contact%u@example.com", i);
+
+	c->status = g_strdup (statuses[
+			g_rand_int_range (rand, 0, G_N_ELEMENTS (statuses))]);
+	c->message = g_strdup (messages[
+			g_rand_int_range (rand, 0, G_N_ELEMENTS (messages))]);
+
+	/* many contacts only have a first name as their alias */
+	if (g_rand_boolean (rand))
+	{
+		c->alias = g_strdup (first_names[g_rand_int_range (rand,
+				0, G_N_ELEMENTS (first_names))]);
+	}
+	else
+	{
+		c->alias = g_strdup_printf ("Contact %u", i);
+	}
+
+	c->n_groups = g_rand_int_range (rand, 0, MAX_GROUPS_PER_CONTACT + 1);
+	for (j = 0; j < c->n_groups; j++)
+	{
+		c->groups[j] = g_strdup (groups[g_rand_int_range (rand,
+				0, G_N_ELEMENTS (groups))]);
+	}
+}
+
+static void
+free_contact (CopiedContact *c)
+{
+	guint j;
+
+	g_free (c->identifier);
+	g_free (c->alias);
+	g_free (c->status);
+	g_free (c->message);
+
+	for (j = 0; j < c->n_groups; j++)
+	{
+		g_free (c->groups[j]);
+	}
+}
+
+int
+main (int argc, char **argv)
+{
+	guint n_contacts = DEFAULT_N_CONTACTS;
+	gsize start, copied, pooled;
+	guint i, j;
+
+	if (argc > 1)
+	{
+		n_contacts = atoi (argv[1]);
+	}
+
+	/* before: every contact holds its own copies */
+	GRand *rand = g_rand_new_with_seed (42);
+
+	start = heap_in_use ();
+
+	CopiedContact *copies = g_new0 (CopiedContact, n_contacts);
+
+	for (i = 0; i < n_contacts; i++)
+	{
+		generate_contact (rand, i, copies + i);
+	}
+
+	copied = heap_growth (start);
+
+	for (i = 0; i < n_contacts; i++)
+	{
+		free_contact (copies + i);
+	}
+
+	g_free (copies);
+	g_rand_free (rand);
+
+	/* after: every contact holds ids into a StringPool; the strings
+	 * generated for each contact are only temporary */
+	rand = g_rand_new_with_seed (42);
+
+	start = heap_in_use ();
+
+	StringPool *pool = string_pool_new ();
+	PooledContact *contacts = g_new0 (PooledContact, n_contacts);
+
+	for (i = 0; i < n_contacts; i++)
+	{
+		PooledContact *p = contacts + i;
+		CopiedContact c;
+
+		generate_contact (rand, i, &c);
+
+		p->identifier = string_pool_ref (pool, c.identifier);
+		p->alias = string_pool_ref (pool, c.alias);
+		p->status = string_pool_ref (pool, c.status);
+		p->message = string_pool_ref (pool, c.message);
+
+		p->n_groups = c.n_groups;
+		for (j = 0; j < c.n_groups; j++)
+		{
+			p->groups[j] = string_pool_ref (pool, c.groups[j]);
+		}
+
+		free_contact (&c);
+	}
+
+	pooled = heap_growth (start);
+
+	g_print ("synthetic roster: %u contacts\n", n_contacts);
+	g_print ("distinct strings: %u (%" G_GSIZE_FORMAT " bytes)\n",
+			string_pool_get_n_strings (pool),
+			string_pool_get_size (pool));
+#ifdef HAVE_MALLINFO2
+	g_print ("before (copied):  %" G_GSIZE_FORMAT " bytes of heap\n",
+			copied);
+	g_print ("after (pooled):   %" G_GSIZE_FORMAT " bytes of heap\n",
+			pooled);
+
+	if (copied > 0)
+	{
+		g_print ("saving:           %.1f%%\n",
+				100.0 * (1.0 - (gdouble) pooled / copied));
+	}
+#else
+	g_print ("before (copied):  unavailable\n");
+	g_print ("after (pooled):   unavailable\n");
+#endif
+
+	/* drop every reference again, which should leave an empty pool */
+	for (i = 0; i < n_contacts; i++)
+	{
+		PooledContact *p = contacts + i;
+
+		string_pool_unref (pool, p->identifier);
+		string_pool_unref (pool, p->alias);
+		string_pool_unref (pool, p->status);
+		string_pool_unref (pool, p->message);
+
+		for (j = 0; j < p->n_groups; j++)
+		{
+			string_pool_unref (pool, p->groups[j]);
+		}
+	}
+
+	g_assert (string_pool_get_n_strings (pool) == 1);
+
+	g_rand_free (rand);
+	g_free (contacts);
+	string_pool_free (pool);
+
+	return 0;
+}
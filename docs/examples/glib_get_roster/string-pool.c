@@ -0,0 +1,172 @@
+#include <string.h>
+
+#include "string-pool.h"
+
+typedef struct
+{
+	char *str;	/* NULL if this id is free */
+	guint32 refcount;
+} PoolEntry;
+
+struct _StringPool
+{
+	/* indexed by id */
+	GArray *entries;	/* of PoolEntry */
+	GHashTable *ids;	/* str -> id, the key is owned by the entry */
+
+	/* ids released by string_pool_unref, reused before growing */
+	GArray *free_ids;	/* of guint32 */
+
+	gsize size;		/* bytes of string data held */
+};
+
+StringPool *
+string_pool_new (void)
+{
+	StringPool *self = g_slice_new0 (StringPool);
+	PoolEntry empty = { g_strdup (""), 1 };
+
+	self->entries = g_array_new (FALSE, FALSE, sizeof (PoolEntry));
+	self->ids = g_hash_table_new (g_str_hash, g_str_equal);
+	self->free_ids = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	/* id 0 is the empty string, and is never released */
+	g_array_append_val (self->entries, empty);
+	g_hash_table_insert (self->ids, empty.str, GUINT_TO_POINTER (0));
+
+	return self;
+}
+
+void
+string_pool_free (StringPool *self)
+{
+	guint i;
+
+	for (i = 0; i < self->entries->len; i++)
+	{
+		g_free (g_array_index (self->entries, PoolEntry, i).str);
+	}
+
+	g_array_free (self->entries, TRUE);
+	g_array_free (self->free_ids, TRUE);
+	g_hash_table_destroy (self->ids);
+
+	g_slice_free (StringPool, self);
+}
+
+/* returns the id for @str, adding it to the pool if needed, and takes a
+ * reference on it; NULL is treated as the empty string */
+guint32
+string_pool_ref (StringPool	*self,
+		 const char	*str)
+{
+	gpointer value;
+	guint32 id;
+
+	if (str == NULL || *str == '\0')
+	{
+		return 0;
+	}
+
+	if (g_hash_table_lookup_extended (self->ids, str, NULL, &value))
+	{
+		id = GPOINTER_TO_UINT (value);
+		g_array_index (self->entries, PoolEntry, id).refcount++;
+
+		return id;
+	}
+
+	PoolEntry entry = { g_strdup (str), 1 };
+
+	if (self->free_ids->len > 0)
+	{
+		id = g_array_index (self->free_ids, guint32,
+				self->free_ids->len - 1);
+		g_array_set_size (self->free_ids, self->free_ids->len - 1);
+		g_array_index (self->entries, PoolEntry, id) = entry;
+	}
+	else
+	{
+		id = self->entries->len;
+		g_array_append_val (self->entries, entry);
+	}
+
+	g_hash_table_insert (self->ids, entry.str, GUINT_TO_POINTER (id));
+	self->size += strlen (entry.str) + 1;
+
+	return id;
+}
+
+void
+string_pool_unref (StringPool	*self,
+		   guint32	 id)
+{
+	g_return_if_fail (id < self->entries->len);
+
+	PoolEntry *entry = &g_array_index (self->entries, PoolEntry, id);
+
+	/* the empty string is always in the pool */
+	if (id == 0)
+	{
+		return;
+	}
+
+	g_return_if_fail (entry->str != NULL);
+
+	if (--entry->refcount > 0)
+	{
+		return;
+	}
+
+	g_hash_table_remove (self->ids, entry->str);
+	self->size -= strlen (entry->str) + 1;
+	g_free (entry->str);
+	entry->str = NULL;
+
+	g_array_append_val (self->free_ids, id);
+}
+
+/* returns the id for @str without taking a reference, or G_MAXUINT32 if
+ * @str is not in the pool */
+guint32
+string_pool_lookup (StringPool	*self,
+		    const char	*str)
+{
+	gpointer value;
+
+	if (str == NULL)
+	{
+		return 0;
+	}
+
+	if (!g_hash_table_lookup_extended (self->ids, str, NULL, &value))
+	{
+		return G_MAXUINT32;
+	}
+
+	return GPOINTER_TO_UINT (value);
+}
+
+const char *
+string_pool_get (StringPool	*self,
+		 guint32	 id)
+{
+	g_return_val_if_fail (id < self->entries->len, NULL);
+
+	return g_array_index (self->entries, PoolEntry, id).str;
+}
+
+/* the number of distinct strings held */
+guint
+string_pool_get_n_strings (StringPool *self)
+{
+	return g_hash_table_size (self->ids);
+}
+
+/* the number of bytes of string data held, not counting the pool's own
+ * bookkeeping */
+gsize
+string_pool_get_size (StringPool *self)
+{
+	return self->size;
+}
@@ -0,0 +1,34 @@
+#ifndef __STRING_POOL_H__
+#define __STRING_POOL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A StringPool interns strings that are repeated across a roster (status
+ * names, status messages, group names, ...) so each distinct string is only
+ * stored once. Strings are referred to by an integer id, which is cheaper to
+ * store and compare than the string itself. Id 0 is always the empty string.
+ *
+ * Each id is reference counted, once the last reference to a string is
+ * dropped its id may be reused. */
+typedef struct _StringPool StringPool;
+
+StringPool *string_pool_new (void);
+void string_pool_free (StringPool *self);
+
+guint32 string_pool_ref (StringPool	*self,
+			 const char	*str);
+void string_pool_unref (StringPool	*self,
+			guint32		 id);
+guint32 string_pool_lookup (StringPool	*self,
+			    const char	*str);
+const char *string_pool_get (StringPool	*self,
+			     guint32	 id);
+
+guint string_pool_get_n_strings (StringPool *self);
+gsize string_pool_get_size (StringPool *self);
+
+G_END_DECLS
+
+#endif
@@ -4,8 +4,20 @@
 
 #include <telepathy-glib/telepathy-glib.h>
 
+#include "group-index.h"
+
 static GMainLoop *loop = NULL;
 
+/* which contacts are in which groups, and the group channels that keep it
+ * up to date */
+static GroupIndex *groups = NULL;
+static GPtrArray *group_channels = NULL;
+
+/* the contacts to list whenever a group changes: those in every group in
+ * query_all and none of the groups in query_none */
+static GPtrArray *query_all = NULL;
+static GPtrArray *query_none = NULL;
+
 static void
 handle_error (const GError *error)
 {
@@ -17,6 +29,156 @@ handle_error (const GError *error)
 }
 
 
+static gboolean
+resolve_groups (GPtrArray *names,
+    GArray *ids)
+{
+  guint i;
+
+  for (i = 0; i < names->len; i++)
+    {
+      guint id;
+
+      if (!group_index_lookup_group (groups,
+            g_ptr_array_index (names, i), &id))
+        return FALSE;
+
+      g_array_append_val (ids, id);
+    }
+
+  return TRUE;
+}
+
+
+static void
+run_query (void)
+{
+  GArray *all, *none, *handles;
+  guint i;
+
+  if (query_all->len == 0 && query_none->len == 0)
+    return;
+
+  all = g_array_new (FALSE, FALSE, sizeof (guint));
+  none = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  /* nobody can be in a group we haven't seen yet, and everybody is not in
+   * it, so unknown groups are dropped from query_none */
+  if (resolve_groups (query_all, all))
+    {
+      for (i = 0; i < query_none->len; i++)
+        {
+          guint id;
+
+          if (group_index_lookup_group (groups,
+                g_ptr_array_index (query_none, i), &id))
+            g_array_append_val (none, id);
+        }
+
+      handles = group_index_query (groups,
+          (guint *) all->data, all->len,
+          (guint *) none->data, none->len);
+
+      g_print ("%u contacts match:", handles->len);
+      for (i = 0; i < handles->len; i++)
+        g_print (" %u", g_array_index (handles, TpHandle, i));
+      g_print ("\n");
+
+      g_array_free (handles, TRUE);
+    }
+
+  g_array_free (all, TRUE);
+  g_array_free (none, TRUE);
+}
+
+
+static void
+_group_members_changed (TpChannel *channel,
+    const char *message,
+    GArray *added,
+    GArray *removed,
+    GArray *local_pending,
+    GArray *remote_pending,
+    TpHandle actor,
+    guint reason,
+    gpointer user_data)
+{
+  guint id = GPOINTER_TO_UINT (user_data);
+
+  group_index_members_changed (groups, id, added, removed);
+
+  g_print ("Group %s: %u added, %u removed, %u members\n",
+      group_index_get_group_name (groups, id),
+      added->len, removed->len,
+      group_index_get_members (groups, id)->len);
+
+  run_query ();
+}
+
+
+static void
+_group_ready (GObject *channel,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  guint id = GPOINTER_TO_UINT (user_data);
+  GArray *members;
+  GError *error = NULL;
+
+  if (!tp_proxy_prepare_finish (channel, res, &error))
+    {
+      handle_error (error);
+      return;
+    }
+
+  /* start with the current members, and follow their changes */
+  members = tp_intset_to_array (
+      tp_channel_group_get_members (TP_CHANNEL (channel)));
+  group_index_members_changed (groups, id, members, NULL);
+  g_array_free (members, TRUE);
+
+  g_print ("Group %s has %u members\n",
+      group_index_get_group_name (groups, id),
+      group_index_get_members (groups, id)->len);
+
+  g_signal_connect (channel, "group-members-changed",
+      G_CALLBACK (_group_members_changed), user_data);
+
+  run_query ();
+}
+
+
+static void
+track_group (TpConnection *conn,
+    const char *object_path,
+    GHashTable *map,
+    const char *name)
+{
+  GQuark features[] = { TP_CHANNEL_FEATURE_GROUP, 0 };
+  TpChannel *channel;
+  guint id;
+  GError *error = NULL;
+
+  /* we may hear about the same group from Channels and NewChannels */
+  if (group_index_lookup_group (groups, name, NULL))
+    return;
+
+  id = group_index_add_group (groups, name);
+
+  channel = tp_channel_new_from_properties (conn, object_path, map, &error);
+  if (channel == NULL)
+    {
+      handle_error (error);
+      return;
+    }
+
+  g_ptr_array_add (group_channels, channel);
+
+  tp_proxy_prepare_async (channel, features, _group_ready,
+      GUINT_TO_POINTER (id));
+}
+
+
 /* begin ex.channel.contactlist.user-defined.glib */
 static void
 new_channels_cb (TpConnection *conn,
@@ -62,6 +224,38 @@ new_channels_cb (TpConnection *conn,
 /* end ex.channel.contactlist.user-defined.glib */
 
 
+/* indexes the user-defined groups among @channels, alongside
+ * new_channels_cb() listing them */
+static void
+index_new_channels_cb (TpConnection *conn,
+    const GPtrArray *channels,
+    gpointer user_data,
+    GObject *weak_obj)
+{
+  int i;
+
+  for (i = 0; i < channels->len; i++)
+    {
+      GValueArray *channel = g_ptr_array_index (channels, i);
+      char *object_path;
+      GHashTable *map;
+
+      tp_value_array_unpack (channel, 2,
+          &object_path,
+          &map);
+
+      if (!tp_strdiff (tp_asv_get_string (map, TP_PROP_CHANNEL_CHANNEL_TYPE),
+            TP_IFACE_CHANNEL_TYPE_CONTACT_LIST) &&
+          tp_asv_get_uint32 (map, TP_PROP_CHANNEL_TARGET_HANDLE_TYPE,
+            NULL) == TP_HANDLE_TYPE_GROUP)
+        {
+          track_group (conn, object_path, map,
+              tp_asv_get_string (map, TP_PROP_CHANNEL_TARGET_ID));
+        }
+    }
+}
+
+
 static void
 get_channels_cb (TpProxy *conn,
     const GValue *value,
@@ -77,6 +271,7 @@ get_channels_cb (TpProxy *conn,
   GPtrArray *channels = g_value_get_boxed (value);
 
   new_channels_cb (TP_CONNECTION (conn), channels, user_data, weak_obj);
+  index_new_channels_cb (TP_CONNECTION (conn), channels, user_data, weak_obj);
 }
 
 
@@ -110,6 +305,11 @@ _conn_ready (GObject *conn,
           TP_CONNECTION (conn), new_channels_cb,
           NULL, NULL, NULL, &error);
       handle_error (error);
+
+      tp_cli_connection_interface_requests_connect_to_new_channels (
+          TP_CONNECTION (conn), index_new_channels_cb,
+          NULL, NULL, NULL, &error);
+      handle_error (error);
     }
   else
     {
@@ -149,14 +349,32 @@ main (int argc,
   TpAccount *account;
   char *account_path;
   GError *error = NULL;
+  int i;
 
   g_type_init ();
 
-  if (argc != 2)
+  /* example ACCOUNT [+GROUP|-GROUP ...] lists the contacts in all of the
+   * +GROUPs and none of the -GROUPs whenever a group changes */
+  if (argc < 2)
     {
       g_error ("Must provide an account!");
     }
 
+  groups = group_index_new ();
+  group_channels = g_ptr_array_new_with_free_func (g_object_unref);
+  query_all = g_ptr_array_new ();
+  query_none = g_ptr_array_new ();
+
+  for (i = 2; i < argc; i++)
+    {
+      if (argv[i][0] == '-')
+        g_ptr_array_add (query_none, argv[i] + 1);
+      else if (argv[i][0] == '+')
+        g_ptr_array_add (query_all, argv[i] + 1);
+      else
+        g_ptr_array_add (query_all, argv[i]);
+    }
+
   /* create a main loop */
   loop = g_main_loop_new (NULL, FALSE);
 
@@ -186,6 +404,10 @@ main (int argc,
 
   g_object_unref (dbus);
   g_object_unref (account);
+  g_ptr_array_free (group_channels, TRUE);
+  g_ptr_array_free (query_all, TRUE);
+  g_ptr_array_free (query_none, TRUE);
+  group_index_free (groups);
 
   return 0;
 }
@@ -0,0 +1,342 @@
+#include <string.h>
+
+#include "group-index.h"
+
+#define BITS_PER_WORD (sizeof (gulong) * 8)
+
+typedef struct
+{
+  char *name;
+
+  /* sorted array of TpHandle */
+  GArray *members;
+} Group;
+
+struct _GroupIndex
+{
+  /* group id -> Group */
+  GPtrArray *groups;
+  /* group name -> group id + 1 */
+  GHashTable *ids;
+
+  /* handle -> bitmap of the ids of the groups it's in, each bitmap is
+   * @stride words long */
+  GArray *bitmaps;
+  guint stride;
+  guint n_handles;
+};
+
+
+static void
+group_free (Group *group)
+{
+  g_free (group->name);
+  g_array_free (group->members, TRUE);
+  g_slice_free (Group, group);
+}
+
+
+GroupIndex *
+group_index_new (void)
+{
+  GroupIndex *self = g_slice_new0 (GroupIndex);
+
+  self->groups = g_ptr_array_new_with_free_func ((GDestroyNotify) group_free);
+  self->ids = g_hash_table_new (g_str_hash, g_str_equal);
+  self->bitmaps = g_array_new (FALSE, TRUE, sizeof (gulong));
+  self->stride = 1;
+
+  return self;
+}
+
+
+void
+group_index_free (GroupIndex *self)
+{
+  g_hash_table_destroy (self->ids);
+  g_ptr_array_free (self->groups, TRUE);
+  g_array_free (self->bitmaps, TRUE);
+
+  g_slice_free (GroupIndex, self);
+}
+
+
+static gulong *
+contact_bitmap (GroupIndex *self,
+    TpHandle handle)
+{
+  if (handle >= self->n_handles)
+    return NULL;
+
+  return &g_array_index (self->bitmaps, gulong, handle * self->stride);
+}
+
+
+static void
+ensure_handle (GroupIndex *self,
+    TpHandle handle)
+{
+  if (handle < self->n_handles)
+    return;
+
+  /* new bitmaps are zeroed by the array */
+  self->n_handles = handle + 1;
+  g_array_set_size (self->bitmaps, self->n_handles * self->stride);
+}
+
+
+static void
+ensure_group_bits (GroupIndex *self,
+    guint n_groups)
+{
+  guint stride = self->stride;
+  GArray *bitmaps;
+  TpHandle handle;
+
+  while (stride * BITS_PER_WORD < n_groups)
+    stride *= 2;
+
+  if (stride == self->stride)
+    return;
+
+  /* widen every contact's bitmap */
+  bitmaps = g_array_new (FALSE, TRUE, sizeof (gulong));
+  g_array_set_size (bitmaps, self->n_handles * stride);
+
+  for (handle = 0; handle < self->n_handles; handle++)
+    memcpy (&g_array_index (bitmaps, gulong, handle * stride),
+        contact_bitmap (self, handle), self->stride * sizeof (gulong));
+
+  g_array_free (self->bitmaps, TRUE);
+  self->bitmaps = bitmaps;
+  self->stride = stride;
+}
+
+
+/* returns whether @handle is in @members, and in @index where it is or
+ * would be inserted */
+static gboolean
+find_member (GArray *members,
+    TpHandle handle,
+    guint *index)
+{
+  guint lo = 0, hi = members->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (g_array_index (members, TpHandle, mid) < handle)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  *index = lo;
+
+  return lo < members->len && g_array_index (members, TpHandle, lo) == handle;
+}
+
+
+/* returns the id of the group called @name, adding it if it's new */
+guint
+group_index_add_group (GroupIndex *self,
+    const char *name)
+{
+  Group *group;
+  guint id;
+
+  if (group_index_lookup_group (self, name, &id))
+    return id;
+
+  group = g_slice_new (Group);
+  group->name = g_strdup (name);
+  group->members = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+
+  id = self->groups->len;
+  g_ptr_array_add (self->groups, group);
+  g_hash_table_insert (self->ids, group->name, GUINT_TO_POINTER (id + 1));
+
+  ensure_group_bits (self, self->groups->len);
+
+  return id;
+}
+
+
+gboolean
+group_index_lookup_group (GroupIndex *self,
+    const char *name,
+    guint *id)
+{
+  guint value = GPOINTER_TO_UINT (g_hash_table_lookup (self->ids, name));
+
+  if (value == 0)
+    return FALSE;
+
+  if (id != NULL)
+    *id = value - 1;
+
+  return TRUE;
+}
+
+
+const char *
+group_index_get_group_name (GroupIndex *self,
+    guint id)
+{
+  g_return_val_if_fail (id < self->groups->len, NULL);
+
+  return ((Group *) g_ptr_array_index (self->groups, id))->name;
+}
+
+
+/* updates the index from the group's MembersChanged signal; @added and
+ * @removed are arrays of TpHandle */
+void
+group_index_members_changed (GroupIndex *self,
+    guint id,
+    const GArray *added,
+    const GArray *removed)
+{
+  Group *group;
+  guint word = id / BITS_PER_WORD;
+  gulong bit = 1UL << (id % BITS_PER_WORD);
+  guint i, index;
+
+  g_return_if_fail (id < self->groups->len);
+
+  group = g_ptr_array_index (self->groups, id);
+
+  for (i = 0; added != NULL && i < added->len; i++)
+    {
+      TpHandle handle = g_array_index (added, TpHandle, i);
+
+      ensure_handle (self, handle);
+      contact_bitmap (self, handle)[word] |= bit;
+
+      if (!find_member (group->members, handle, &index))
+        g_array_insert_val (group->members, index, handle);
+    }
+
+  for (i = 0; removed != NULL && i < removed->len; i++)
+    {
+      TpHandle handle = g_array_index (removed, TpHandle, i);
+      gulong *bitmap = contact_bitmap (self, handle);
+
+      if (bitmap != NULL)
+        bitmap[word] &= ~bit;
+
+      if (find_member (group->members, handle, &index))
+        g_array_remove_index (group->members, index);
+    }
+}
+
+
+/* returns the members of the group as a sorted array of TpHandle, owned by
+ * the index */
+const GArray *
+group_index_get_members (GroupIndex *self,
+    guint id)
+{
+  g_return_val_if_fail (id < self->groups->len, NULL);
+
+  return ((Group *) g_ptr_array_index (self->groups, id))->members;
+}
+
+
+/* returns the ids of the groups @handle is in, free with g_array_free() */
+GArray *
+group_index_get_groups (GroupIndex *self,
+    TpHandle handle)
+{
+  GArray *ids = g_array_new (FALSE, FALSE, sizeof (guint));
+  gulong *bitmap = contact_bitmap (self, handle);
+  guint w;
+
+  for (w = 0; bitmap != NULL && w < self->stride; w++)
+    {
+      gint bit = -1;
+
+      while ((bit = g_bit_nth_lsf (bitmap[w], bit)) != -1)
+        {
+          guint id = w * BITS_PER_WORD + bit;
+
+          g_array_append_val (ids, id);
+        }
+    }
+
+  return ids;
+}
+
+
+/* returns the contacts in every group in @in_all and in none of the groups
+ * in @in_none, as a sorted array of TpHandle; free with g_array_free().
+ * Returns NULL if any of the group ids is unknown.
+ *
+ * If @in_all is empty, every contact in at least one group is considered. */
+GArray *
+group_index_query (GroupIndex *self,
+    const guint *in_all,
+    guint n_in_all,
+    const guint *in_none,
+    guint n_in_none)
+{
+  GArray *result;
+  gulong *all, *none;
+  const GArray *candidates = NULL;
+  guint i, w, n;
+
+  for (i = 0; i < n_in_all; i++)
+    g_return_val_if_fail (in_all[i] < self->groups->len, NULL);
+
+  for (i = 0; i < n_in_none; i++)
+    g_return_val_if_fail (in_none[i] < self->groups->len, NULL);
+
+  result = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+  all = g_new0 (gulong, self->stride);
+  none = g_new0 (gulong, self->stride);
+
+  for (i = 0; i < n_in_all; i++)
+    {
+      const GArray *members;
+
+      all[in_all[i] / BITS_PER_WORD] |= 1UL << (in_all[i] % BITS_PER_WORD);
+
+      /* only the members of the smallest group need to be looked at */
+      members = group_index_get_members (self, in_all[i]);
+      if (candidates == NULL || members->len < candidates->len)
+        candidates = members;
+    }
+
+  for (i = 0; i < n_in_none; i++)
+    none[in_none[i] / BITS_PER_WORD] |= 1UL << (in_none[i] % BITS_PER_WORD);
+
+  n = candidates != NULL ? candidates->len : self->n_handles;
+
+  for (i = 0; i < n; i++)
+    {
+      TpHandle handle = candidates != NULL ?
+          g_array_index (candidates, TpHandle, i) : i;
+      gulong *bitmap = contact_bitmap (self, handle);
+      gulong any = 0;
+
+      for (w = 0; w < self->stride; w++)
+        {
+          if ((bitmap[w] & all[w]) != all[w] || (bitmap[w] & none[w]) != 0)
+            break;
+
+          any |= bitmap[w];
+        }
+
+      /* the handle failed the test, or isn't in any group at all */
+      if (w < self->stride || any == 0)
+        continue;
+
+      g_array_append_val (result, handle);
+    }
+
+  g_free (all);
+  g_free (none);
+
+  return result;
+}
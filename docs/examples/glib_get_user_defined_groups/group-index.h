@@ -0,0 +1,46 @@
+#ifndef __GROUP_INDEX_H__
+#define __GROUP_INDEX_H__
+
+#include <glib.h>
+
+#include <telepathy-glib/handle.h>
+
+G_BEGIN_DECLS
+
+/* An index of which contacts are in which user-defined groups.
+ *
+ * Each group is given a small integer id when it's added. Every contact has
+ * a bitmap of the ids of the groups it's in, so asking which groups a
+ * contact is in, or whether it's in some groups and not others, is a few
+ * word operations, and every group keeps a sorted array of its members. */
+typedef struct _GroupIndex GroupIndex;
+
+GroupIndex *group_index_new (void);
+void group_index_free (GroupIndex *self);
+
+guint group_index_add_group (GroupIndex *self,
+    const char *name);
+gboolean group_index_lookup_group (GroupIndex *self,
+    const char *name,
+    guint *id);
+const char *group_index_get_group_name (GroupIndex *self,
+    guint id);
+
+void group_index_members_changed (GroupIndex *self,
+    guint id,
+    const GArray *added,
+    const GArray *removed);
+
+const GArray *group_index_get_members (GroupIndex *self,
+    guint id);
+GArray *group_index_get_groups (GroupIndex *self,
+    TpHandle handle);
+GArray *group_index_query (GroupIndex *self,
+    const guint *in_all,
+    guint n_in_all,
+    const guint *in_none,
+    guint n_in_none);
+
+G_END_DECLS
+
+#endif
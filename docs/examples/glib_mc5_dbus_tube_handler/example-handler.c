@@ -9,6 +9,8 @@
 #include <telepathy-glib/util.h>
 
 #include "example-handler.h"
+#include "connection-cache.h"
+#include "dispatch-stats.h"
 
 #define SERVICE_NAME "org.freedesktop.Telepathy.Examples.TubeClient"
 
@@ -43,6 +45,10 @@ struct _ExampleHandlerPrivate
 {
   GList *channels;
 
+  /* connections seen by earlier dispatches, so they don't have to be
+   * prepared again */
+  ConnectionCache *connections;
+
   TpTubeState state;
   char *address;
 };
@@ -168,20 +174,31 @@ example_handler_handle_channels (TpSvcClientHandler   *self,
                                  GHashTable            *handler_info,
                                  DBusGMethodInvocation *context)
 {
+  ExampleHandlerPrivate *priv = GET_PRIVATE (self);
+  DispatchTimer *timer = dispatch_timer_new ("HandleChannels");
   GError *error = NULL;
 
-  TpDBusDaemon *bus = tp_dbus_daemon_dup (&error);
-  if (error != NULL)
+  if (priv->connections == NULL)
     {
-      g_error ("%s", error->message);
+      TpDBusDaemon *bus = tp_dbus_daemon_dup (&error);
+      if (error != NULL)
+        {
+          g_error ("%s", error->message);
+        }
+
+      priv->connections = connection_cache_new (bus);
+      g_object_unref (bus);
     }
 
-  TpConnection *conn = tp_connection_new (bus, NULL, connection, &error);
+  TpConnection *conn = connection_cache_get (priv->connections, connection,
+      &error);
   if (error != NULL)
     {
       g_error ("%s", error->message);
     }
 
+  dispatch_timer_mark (timer, DISPATCH_PHASE_CALLS);
+
   /* channels is of type a(oa{sv}) */
   int i;
   for (i = 0; i < channels->len; i++)
@@ -218,9 +235,9 @@ example_handler_handle_channels (TpSvcClientHandler   *self,
     }
 
   g_object_unref (conn);
-  g_object_unref (bus);
 
   tp_svc_client_handler_return_from_handle_channels (context);
+  dispatch_timer_finish (timer);
 }
 
 static void
@@ -288,12 +305,26 @@ example_handler_get_property (GObject    *self,
     }
 }
 
+static void
+example_handler_finalize (GObject *self)
+{
+  ExampleHandlerPrivate *priv = GET_PRIVATE (self);
+
+  if (priv->connections != NULL)
+    {
+      connection_cache_free (priv->connections);
+    }
+
+  G_OBJECT_CLASS (example_handler_parent_class)->finalize (self);
+}
+
 static void
 example_handler_class_init (ExampleHandlerClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
   object_class->get_property = example_handler_get_property;
+  object_class->finalize = example_handler_finalize;
 
   /* D-Bus properties are exposed as GObject properties through the
    * TpDBusPropertiesMixin */
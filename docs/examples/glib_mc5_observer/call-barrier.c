@@ -0,0 +1,195 @@
+#include "call-barrier.h"
+
+struct _CallBarrierCall
+{
+  CallBarrier *barrier;
+  char *name;
+};
+
+struct _CallBarrier
+{
+  guint timeout_ms;
+  CallBarrierFunc func;
+  gpointer user_data;
+  GDestroyNotify destroy;
+
+  /* the calls that haven't finished yet */
+  GPtrArray *pending;
+  /* the names of the calls that finished after the deadline */
+  GPtrArray *late;
+
+  GTimer *timer;
+  guint timeout_id;
+  gboolean started;
+  gboolean done;
+};
+
+
+CallBarrier *
+call_barrier_new (guint timeout_ms,
+    CallBarrierFunc func,
+    gpointer user_data,
+    GDestroyNotify destroy)
+{
+  CallBarrier *self = g_slice_new0 (CallBarrier);
+
+  self->timeout_ms = timeout_ms;
+  self->func = func;
+  self->user_data = user_data;
+  self->destroy = destroy;
+
+  self->pending = g_ptr_array_new ();
+  self->late = g_ptr_array_new_with_free_func (g_free);
+  self->timer = g_timer_new ();
+
+  return self;
+}
+
+
+static void
+call_barrier_free (CallBarrier *self)
+{
+  if (self->late->len > 0)
+    {
+      char *names;
+
+      g_ptr_array_add (self->late, NULL);
+      names = g_strjoinv (", ", (char **) self->late->pdata);
+
+      g_message ("%u calls finished after the deadline: %s",
+          self->late->len - 1, names);
+
+      g_free (names);
+    }
+
+  if (self->destroy != NULL)
+    self->destroy (self->user_data);
+
+  g_ptr_array_free (self->pending, TRUE);
+  g_ptr_array_free (self->late, TRUE);
+  g_timer_destroy (self->timer);
+
+  g_slice_free (CallBarrier, self);
+}
+
+
+static void
+call_barrier_finish (CallBarrier *self,
+    gboolean timed_out)
+{
+  self->done = TRUE;
+
+  if (self->timeout_id != 0)
+    {
+      g_source_remove (self->timeout_id);
+      self->timeout_id = 0;
+    }
+
+  self->func (self, timed_out, self->user_data);
+
+  /* the barrier stays around until the late calls finish, so they can
+   * still leave it */
+  if (self->pending->len == 0)
+    call_barrier_free (self);
+}
+
+
+static gboolean
+_call_barrier_timeout (gpointer user_data)
+{
+  CallBarrier *self = user_data;
+  guint i;
+
+  self->timeout_id = 0;
+
+  for (i = 0; i < self->pending->len; i++)
+    {
+      CallBarrierCall *call = g_ptr_array_index (self->pending, i);
+
+      g_warning ("%s still pending after %u ms", call->name,
+          self->timeout_ms);
+    }
+
+  call_barrier_finish (self, TRUE);
+
+  return FALSE;
+}
+
+
+/* adds a call to wait for; the returned call must be passed to
+ * call_barrier_leave() when it finishes, usually as the user_data of its
+ * callback */
+CallBarrierCall *
+call_barrier_enter (CallBarrier *self,
+    const char *format,
+    ...)
+{
+  CallBarrierCall *call;
+  va_list args;
+
+  g_return_val_if_fail (!self->done, NULL);
+
+  call = g_slice_new (CallBarrierCall);
+  call->barrier = self;
+
+  va_start (args, format);
+  call->name = g_strdup_vprintf (format, args);
+  va_end (args);
+
+  g_ptr_array_add (self->pending, call);
+
+  return call;
+}
+
+
+void
+call_barrier_leave (CallBarrierCall *call)
+{
+  CallBarrier *self = call->barrier;
+
+  g_ptr_array_remove_fast (self->pending, call);
+
+  if (self->done)
+    {
+      gdouble late = g_timer_elapsed (self->timer, NULL) * 1000 -
+          self->timeout_ms;
+
+      g_debug ("%s finished %.0f ms after the deadline", call->name, late);
+
+      g_ptr_array_add (self->late, call->name);
+      g_slice_free (CallBarrierCall, call);
+
+      if (self->pending->len == 0)
+        call_barrier_free (self);
+
+      return;
+    }
+
+  g_free (call->name);
+  g_slice_free (CallBarrierCall, call);
+
+  if (self->started && self->pending->len == 0)
+    call_barrier_finish (self, FALSE);
+}
+
+
+/* starts the deadline once all the calls have been entered; if they have
+ * all finished already the barrier's function is called straight away */
+void
+call_barrier_start (CallBarrier *self)
+{
+  g_return_if_fail (!self->started);
+
+  self->started = TRUE;
+
+  if (self->pending->len == 0)
+    {
+      call_barrier_finish (self, FALSE);
+      return;
+    }
+
+  g_timer_start (self->timer);
+  self->timeout_id = g_timeout_add (self->timeout_ms,
+      _call_barrier_timeout, self);
+}
+
@@ -0,0 +1,33 @@
+#ifndef __CALL_BARRIER_H__
+#define __CALL_BARRIER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A CallBarrier waits for a set of asynchronous calls to finish, or for a
+ * deadline to pass, whichever comes first. Calls still outstanding at the
+ * deadline are reported, and again when they do finish, with how late they
+ * were; the barrier is freed once every call has finished. */
+typedef struct _CallBarrier CallBarrier;
+typedef struct _CallBarrierCall CallBarrierCall;
+
+typedef void (* CallBarrierFunc) (CallBarrier *barrier,
+    gboolean timed_out,
+    gpointer user_data);
+
+CallBarrier *call_barrier_new (guint timeout_ms,
+    CallBarrierFunc func,
+    gpointer user_data,
+    GDestroyNotify destroy);
+
+CallBarrierCall *call_barrier_enter (CallBarrier *self,
+    const char *format,
+    ...) G_GNUC_PRINTF (2, 3);
+void call_barrier_leave (CallBarrierCall *call);
+
+void call_barrier_start (CallBarrier *self);
+
+G_END_DECLS
+
+#endif
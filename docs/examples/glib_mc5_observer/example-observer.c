@@ -28,7 +28,8 @@ enum
 {
   PROP_0,
   PROP_INTERFACES,
-  PROP_CHANNEL_FILTER
+  PROP_CHANNEL_FILTER,
+  PROP_RECOVER
 };
 
 // typedef struct _ExampleObserverPrivate ExampleObserverPrivate;
@@ -94,6 +95,14 @@ example_observer_get_property (GObject    *self,
         g_value_set_boxed (value, array);
         break;
 
+      case PROP_RECOVER:
+        g_print (" :: recover\n");
+
+        /* ask to be told about channels that already exist when we're
+         * started, so a restarted observer catches up straight away */
+        g_value_set_boolean (value, TRUE);
+        break;
+
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (self, property_id, pspec);
         break;
@@ -119,6 +128,7 @@ example_observer_class_init (ExampleObserverClass *klass)
   /* properties on the Client.Observer interface */
   static TpDBusPropertiesMixinPropImpl client_observer_props[] = {
         { "ObserverChannelFilter", "channel-filter", NULL },
+        { "Recover", "recover", NULL },
         { NULL }
   };
 
@@ -152,6 +162,13 @@ example_observer_class_init (ExampleObserverClass *klass)
                           TP_ARRAY_TYPE_CHANNEL_CLASS_LIST,
                           G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class, PROP_RECOVER,
+      g_param_spec_boolean ("recover",
+                            "Recover",
+                            "Observe existing channels when started",
+                            TRUE,
+                            G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   /* begin ex.services.glib.properties.chain-up */
   /* call our mixin class init */
   klass->dbus_props_class.interfaces = prop_interfaces;
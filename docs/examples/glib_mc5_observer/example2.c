@@ -1,47 +1,32 @@
 #include <telepathy-glib/telepathy-glib.h>
 
+#include "call-barrier.h"
+#include "dispatch-stats.h"
 
-static guint
-increment_pending (gpointer proxy)
-{
-  guint pending;
-
-  pending = GPOINTER_TO_UINT (g_object_get_data (proxy, "pending"));
-  pending++;
-  g_object_set_data (proxy, "pending", GUINT_TO_POINTER (pending));
 
-  g_debug ("%u calls pending", pending);
-
-  return pending;
-}
-
-
-static guint
-decrement_pending (gpointer proxy)
-{
-  guint pending;
-
-  pending = GPOINTER_TO_UINT (g_object_get_data (proxy, "pending"));
-  pending--;
-  g_object_set_data (proxy, "pending", GUINT_TO_POINTER (pending));
-
-  g_debug ("%u calls pending", pending);
-
-  return pending;
-}
+/* how long ObserveChannels may be held up by our calls; after this the
+ * channels are passed on to the Handler regardless */
+#define OBSERVE_TIMEOUT_MS 5000
 
 
 static void
-respond_to_context (TpObserveChannelsContext *context)
+observe_done (CallBarrier *barrier,
+    gboolean timed_out,
+    gpointer user_data)
 {
-  if (decrement_pending (context) == 0)
-    {
-      g_debug ("ObserveChannels complete");
+  TpObserveChannelsContext *context = user_data;
+  DispatchTimer *timer;
 
-      tp_observe_channels_context_accept (context);
+  if (timed_out)
+    g_debug ("ObserveChannels timed out");
+  else
+    g_debug ("ObserveChannels complete");
 
-      g_object_unref (context);
-    }
+  tp_observe_channels_context_accept (context);
+
+  timer = g_object_steal_data (G_OBJECT (context), "dispatch-timer");
+  if (timer != NULL)
+    dispatch_timer_finish (timer);
 }
 
 
@@ -50,9 +35,9 @@ list_pending_messaged_cb (TpChannel *channel,
     const GPtrArray *pending,
     const GError *in_error,
     gpointer user_data,
-    GObject *context)
+    GObject *weak_obj)
 {
-  respond_to_context (TP_OBSERVE_CHANNELS_CONTEXT (context));
+  call_barrier_leave (user_data);
 
   if (in_error != NULL)
     {
@@ -67,10 +52,9 @@ channel_group_prepared (GObject *channel,
     GAsyncResult *res,
     gpointer user_data)
 {
-  TpObserveChannelsContext *context = user_data;
   GError *error = NULL;
 
-  respond_to_context (context);
+  call_barrier_leave (user_data);
 
   if (!tp_proxy_prepare_finish (channel, res, &error))
     {
@@ -104,10 +88,17 @@ observe_channels (TpSimpleObserver *observer,
     TpObserveChannelsContext *context,
     gpointer user_data)
 {
+  CallBarrier *barrier;
   GList *l;
 
   g_debug ("ObserveChannels");
 
+  /* hold a reference to @context, which the barrier releases when it's
+   * freed, and respond to it from observe_done() once every call we make
+   * below has finished */
+  barrier = call_barrier_new (OBSERVE_TIMEOUT_MS, observe_done,
+      g_object_ref (context), g_object_unref);
+
   for (l = channels; l != NULL; l = l->next)
     {
       TpChannel *channel = l->data;
@@ -116,8 +107,10 @@ observe_channels (TpSimpleObserver *observer,
       /* request the pending message queue */
       tp_cli_channel_type_text_call_list_pending_messages (channel, -1,
           FALSE,
-          list_pending_messaged_cb, NULL, NULL, G_OBJECT (context));
-      increment_pending (context);
+          list_pending_messaged_cb,
+          call_barrier_enter (barrier, "ListPendingMessages on %s",
+            tp_proxy_get_object_path (channel)),
+          NULL, NULL);
 
       tp_channel_get_handle (channel, &handle_type);
       if (handle_type == TP_HANDLE_TYPE_ROOM)
@@ -126,8 +119,8 @@ observe_channels (TpSimpleObserver *observer,
           GQuark features[] = { TP_CHANNEL_FEATURE_GROUP, 0 };
 
           tp_proxy_prepare_async (channel, features, channel_group_prepared,
-              context);
-          increment_pending (context);
+              call_barrier_enter (barrier, "preparing group on %s",
+                tp_proxy_get_object_path (channel)));
         }
 
       /* hold a reference to the channel, that we release on invalidation */
@@ -136,14 +129,44 @@ observe_channels (TpSimpleObserver *observer,
           G_CALLBACK (channel_invalided), NULL);
     }
 
-  /* hold a reference to @context */
-  g_object_ref (context);
-  /* delay responding to @context until our callbacks have finished */
+  /* delay responding to @context until our callbacks have finished, or the
+   * barrier's deadline passes */
   tp_observe_channels_context_delay (context);
+  call_barrier_start (barrier);
 }
 /* end ex.channel-dispatcher.clients.impl.tpsimpleobserver */
 
 
+/* times observe_channels(), and records how long it took once
+ * observe_done() has responded to @context */
+static void
+observe_channels_timed (TpSimpleObserver *observer,
+    TpAccount *account,
+    TpConnection *connection,
+    GList *channels,
+    TpChannelDispatchOperation *dispatch,
+    GList *requests,
+    TpObserveChannelsContext *context,
+    gpointer user_data)
+{
+  /* TpBaseClient has already prepared the proxies, so timing starts with
+   * the calls on each channel */
+  DispatchTimer *timer = dispatch_timer_new ("ObserveChannels");
+
+  dispatch_timer_mark (timer, DISPATCH_PHASE_CALLS);
+  g_object_set_data (G_OBJECT (context), "dispatch-timer", timer);
+
+  observe_channels (observer, account, connection, channels, dispatch,
+      requests, context, user_data);
+
+  /* with no calls to wait for, observe_done() has already taken the
+   * timer */
+  timer = g_object_get_data (G_OBJECT (context), "dispatch-timer");
+  if (timer != NULL)
+    dispatch_timer_mark (timer, DISPATCH_PHASE_WAIT);
+}
+
+
 int
 main (int argc,
     const char **argv)
@@ -160,7 +183,7 @@ main (int argc,
     g_error ("%s", error->message);
 
   observer = tp_simple_observer_new (dbus, TRUE, "ExampleObserver", TRUE,
-      observe_channels, NULL, NULL);
+      observe_channels_timed, NULL, NULL);
 
   /* Observe both 1-to-1 text channels and MUCs */
   tp_base_client_take_observer_filter (observer, tp_asv_new (
@@ -0,0 +1,653 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "avatar-cache.h"
+
+#define GET_PRIVATE(obj)  (G_TYPE_INSTANCE_GET_PRIVATE ((obj), TYPE_AVATAR_CACHE, AvatarCachePrivate))
+
+G_DEFINE_TYPE (AvatarCache, avatar_cache, G_TYPE_OBJECT);
+
+/* Avatars are stored as one file per avatar token, the token identifying
+ * the image, so an avatar only needs fetching from the CM when a contact's
+ * token changes to one we haven't seen.
+ *
+ * The index records what we know about each token, and is laid out as:
+ *  - an IndexHeader
+ *  - n_entries IndexRecords, sorted by token
+ *  - strings_size bytes of NUL-terminated strings, referenced by offset from
+ *    the records. Offset 0 is always the empty string.
+ *
+ * It's mapped when the cache is created; tokens stored since then are kept
+ * in a hash table until the index is next written. Like the roster
+ * snapshot, it's written in host byte order. */
+#define INDEX_MAGIC	0x41565054 /* TPVA */
+#define INDEX_VERSION	1
+
+enum /* record flags */
+{
+  AVATAR_HAS_THUMBNAIL = 1 << 0
+};
+
+enum /* signals */
+{
+  THUMBNAIL_READY,
+  LAST_SIGNAL
+};
+
+static guint _signals[LAST_SIGNAL] = { 0, };
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint32 n_entries;
+  guint32 strings_size;
+} IndexHeader;
+
+typedef struct
+{
+  guint32 token;
+  guint32 mime_type;
+  guint32 size;
+  guint32 flags;
+} IndexRecord;
+
+typedef struct
+{
+  char *mime_type;
+  guint32 size;
+  guint32 flags;
+} AvatarEntry;
+
+typedef struct _AvatarCachePrivate AvatarCachePrivate;
+struct _AvatarCachePrivate
+{
+  char *dir;
+
+  /* the index as it was last written, may be NULL */
+  GMappedFile *index;
+  guint n_records;
+  const IndexRecord *records;
+  const char *strings;
+
+  /* token -> AvatarEntry, for tokens stored or changed since */
+  GHashTable *entries;
+  guint save_id;
+
+  /* token -> GdkPixbuf, for thumbnails that have been asked for */
+  GHashTable *thumbnails;
+
+  GThreadPool *thumbnailer;
+};
+
+typedef struct
+{
+  AvatarCache *self;
+  char *token;
+  char *path;
+  char *thumbnail_path;
+  gboolean success;
+} ThumbnailJob;
+
+
+static void
+avatar_entry_free (AvatarEntry *entry)
+{
+  g_free (entry->mime_type);
+  g_slice_free (AvatarEntry, entry);
+}
+
+
+static char *
+avatar_path (AvatarCachePrivate *priv,
+    const char *token,
+    const char *suffix)
+{
+  char *escaped = tp_escape_as_identifier (token);
+  char *name = g_strconcat (escaped, suffix, NULL);
+  char *path = g_build_filename (priv->dir, name, NULL);
+
+  g_free (escaped);
+  g_free (name);
+
+  return path;
+}
+
+
+static gboolean
+index_validate (const char *contents,
+    gsize length)
+{
+  const IndexHeader *header = (const IndexHeader *) contents;
+  const IndexRecord *records;
+  const char *strings;
+  guint i;
+
+  if (length < sizeof (IndexHeader) ||
+      header->magic != INDEX_MAGIC ||
+      header->version != INDEX_VERSION ||
+      header->strings_size == 0)
+    return FALSE;
+
+  if (header->n_entries > (length - sizeof (IndexHeader)) /
+        sizeof (IndexRecord) ||
+      length != sizeof (IndexHeader) +
+        header->n_entries * sizeof (IndexRecord) + header->strings_size)
+    return FALSE;
+
+  records = (const IndexRecord *) (header + 1);
+  strings = (const char *) (records + header->n_entries);
+
+  if (strings[0] != '\0' || strings[header->strings_size - 1] != '\0')
+    return FALSE;
+
+  for (i = 0; i < header->n_entries; i++)
+    {
+      if (records[i].token >= header->strings_size ||
+          records[i].mime_type >= header->strings_size)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+
+static void
+index_load (AvatarCachePrivate *priv)
+{
+  char *path = g_build_filename (priv->dir, "index", NULL);
+  const IndexHeader *header;
+  GError *error = NULL;
+
+  if (priv->index != NULL)
+    g_mapped_file_unref (priv->index);
+
+  priv->index = NULL;
+  priv->n_records = 0;
+
+  priv->index = g_mapped_file_new (path, FALSE, &error);
+  if (priv->index == NULL)
+    {
+      g_debug ("No avatar index: %s", error->message);
+      g_clear_error (&error);
+      goto finally;
+    }
+
+  if (!index_validate (g_mapped_file_get_contents (priv->index),
+        g_mapped_file_get_length (priv->index)))
+    {
+      g_warning ("Avatar index %s is corrupt, ignoring it", path);
+      g_mapped_file_unref (priv->index);
+      priv->index = NULL;
+      goto finally;
+    }
+
+  header = (const IndexHeader *) g_mapped_file_get_contents (priv->index);
+  priv->n_records = header->n_entries;
+  priv->records = (const IndexRecord *) (header + 1);
+  priv->strings = (const char *) (priv->records + priv->n_records);
+
+finally:
+  g_free (path);
+}
+
+
+static const IndexRecord *
+index_find (AvatarCachePrivate *priv,
+    const char *token)
+{
+  guint lo = 0, hi = priv->n_records;
+
+  /* records are sorted by token */
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      int cmp = strcmp (token, priv->strings + priv->records[mid].token);
+
+      if (cmp == 0)
+        return priv->records + mid;
+      else if (cmp < 0)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+  return NULL;
+}
+
+
+/* looks @token up, first in the entries stored since the index was
+ * loaded, then in the index itself */
+static gboolean
+index_lookup (AvatarCachePrivate *priv,
+    const char *token,
+    guint32 *flags)
+{
+  AvatarEntry *entry = g_hash_table_lookup (priv->entries, token);
+  const IndexRecord *record;
+
+  if (entry != NULL)
+    {
+      *flags = entry->flags;
+      return TRUE;
+    }
+
+  record = index_find (priv, token);
+  if (record == NULL)
+    return FALSE;
+
+  *flags = record->flags;
+
+  return TRUE;
+}
+
+
+static guint32
+add_string (GString *strings,
+    const char *str)
+{
+  guint32 offset;
+
+  if (str == NULL || *str == '\0')
+    return 0;
+
+  offset = strings->len;
+  g_string_append_len (strings, str, strlen (str) + 1);
+
+  return offset;
+}
+
+
+static gint
+compare_tokens (gconstpointer a,
+    gconstpointer b)
+{
+  return strcmp (*(const char **) a, *(const char **) b);
+}
+
+
+static gboolean
+index_save (gpointer user_data)
+{
+  AvatarCache *self = user_data;
+  AvatarCachePrivate *priv = GET_PRIVATE (self);
+  GPtrArray *tokens;
+  GArray *records;
+  GString *strings, *contents;
+  GHashTableIter iter;
+  gpointer token;
+  IndexHeader header = { INDEX_MAGIC, INDEX_VERSION, 0, 0 };
+  char *path;
+  GError *error = NULL;
+  guint i;
+
+  priv->save_id = 0;
+
+  /* merge the new entries with the ones in the index, the new entries
+   * replacing old ones for the same token */
+  tokens = g_ptr_array_new ();
+
+  for (i = 0; i < priv->n_records; i++)
+    {
+      const char *t = priv->strings + priv->records[i].token;
+
+      if (g_hash_table_lookup (priv->entries, t) == NULL)
+        g_ptr_array_add (tokens, (char *) t);
+    }
+
+  g_hash_table_iter_init (&iter, priv->entries);
+  while (g_hash_table_iter_next (&iter, &token, NULL))
+    g_ptr_array_add (tokens, token);
+
+  g_ptr_array_sort (tokens, compare_tokens);
+
+  records = g_array_sized_new (FALSE, FALSE, sizeof (IndexRecord),
+      tokens->len);
+  strings = g_string_new_len ("", 1);
+
+  for (i = 0; i < tokens->len; i++)
+    {
+      const char *t = g_ptr_array_index (tokens, i);
+      AvatarEntry *entry = g_hash_table_lookup (priv->entries, t);
+      IndexRecord record;
+
+      record.token = add_string (strings, t);
+
+      if (entry != NULL)
+        {
+          record.mime_type = add_string (strings, entry->mime_type);
+          record.size = entry->size;
+          record.flags = entry->flags;
+        }
+      else
+        {
+          const IndexRecord *old = index_find (priv, t);
+
+          record.mime_type = add_string (strings,
+              priv->strings + old->mime_type);
+          record.size = old->size;
+          record.flags = old->flags;
+        }
+
+      g_array_append_val (records, record);
+    }
+
+  header.n_entries = records->len;
+  header.strings_size = strings->len;
+
+  contents = g_string_new_len ((const char *) &header, sizeof (header));
+  g_string_append_len (contents, records->data,
+      records->len * sizeof (IndexRecord));
+  g_string_append_len (contents, strings->str, strings->len);
+
+  /* g_file_set_contents() replaces the file atomically, so the old index
+   * stays mapped and valid until we map the new one */
+  path = g_build_filename (priv->dir, "index", NULL);
+  if (g_file_set_contents (path, contents->str, contents->len, &error))
+    {
+      g_hash_table_remove_all (priv->entries);
+      index_load (priv);
+    }
+  else
+    {
+      g_warning ("Failed to write avatar index: %s", error->message);
+      g_clear_error (&error);
+    }
+
+  g_free (path);
+  g_string_free (contents, TRUE);
+  g_string_free (strings, TRUE);
+  g_array_free (records, TRUE);
+  g_ptr_array_free (tokens, TRUE);
+
+  return FALSE;
+}
+
+
+static void
+index_queue_save (AvatarCache *self)
+{
+  AvatarCachePrivate *priv = GET_PRIVATE (self);
+
+  /* write the index once a burst of avatars has been stored */
+  if (priv->save_id == 0)
+    priv->save_id = g_timeout_add_seconds (1, index_save, self);
+}
+
+
+static gboolean
+_thumbnail_done (gpointer user_data)
+{
+  ThumbnailJob *job = user_data;
+  AvatarCachePrivate *priv = GET_PRIVATE (job->self);
+
+  if (job->success)
+    {
+      AvatarEntry *entry = g_hash_table_lookup (priv->entries, job->token);
+
+      /* the index may have been saved since the avatar was stored, in
+       * which case the flag is set on a new entry that replaces it */
+      if (entry == NULL)
+        {
+          const IndexRecord *record = index_find (priv, job->token);
+
+          g_return_val_if_fail (record != NULL, FALSE);
+
+          entry = g_slice_new (AvatarEntry);
+          entry->mime_type = g_strdup (priv->strings + record->mime_type);
+          entry->size = record->size;
+          entry->flags = record->flags;
+          g_hash_table_insert (priv->entries, g_strdup (job->token), entry);
+        }
+
+      entry->flags |= AVATAR_HAS_THUMBNAIL;
+      index_queue_save (job->self);
+
+      g_signal_emit (job->self, _signals[THUMBNAIL_READY], 0, job->token);
+    }
+
+  g_object_unref (job->self);
+  g_free (job->token);
+  g_free (job->path);
+  g_free (job->thumbnail_path);
+  g_slice_free (ThumbnailJob, job);
+
+  return FALSE;
+}
+
+
+/* runs in the thumbnailer thread */
+static void
+_make_thumbnail (gpointer data,
+    gpointer user_data)
+{
+  ThumbnailJob *job = data;
+  GdkPixbuf *pixbuf;
+  GError *error = NULL;
+
+  pixbuf = gdk_pixbuf_new_from_file_at_scale (job->path,
+      AVATAR_CACHE_THUMBNAIL_SIZE, AVATAR_CACHE_THUMBNAIL_SIZE, TRUE,
+      &error);
+
+  if (pixbuf != NULL)
+    {
+      job->success = gdk_pixbuf_save (pixbuf, job->thumbnail_path, "png",
+          &error, NULL);
+      g_object_unref (pixbuf);
+    }
+
+  if (error != NULL)
+    {
+      g_warning ("Failed to thumbnail %s: %s", job->path, error->message);
+      g_clear_error (&error);
+    }
+
+  /* everything else happens in the main thread */
+  g_idle_add (_thumbnail_done, job);
+}
+
+
+static void
+avatar_cache_dispose (GObject *self)
+{
+  AvatarCachePrivate *priv = GET_PRIVATE (self);
+
+  /* thumbnail jobs hold a reference, so there are none left by now */
+  if (priv->thumbnailer != NULL)
+    {
+      g_thread_pool_free (priv->thumbnailer, TRUE, TRUE);
+      priv->thumbnailer = NULL;
+    }
+
+  if (priv->save_id != 0)
+    {
+      g_source_remove (priv->save_id);
+      index_save (self);
+    }
+
+  G_OBJECT_CLASS (avatar_cache_parent_class)->dispose (self);
+}
+
+
+static void
+avatar_cache_finalize (GObject *self)
+{
+  AvatarCachePrivate *priv = GET_PRIVATE (self);
+
+  if (priv->index != NULL)
+    g_mapped_file_unref (priv->index);
+
+  g_hash_table_destroy (priv->entries);
+  g_hash_table_destroy (priv->thumbnails);
+  g_free (priv->dir);
+
+  G_OBJECT_CLASS (avatar_cache_parent_class)->finalize (self);
+}
+
+
+static void
+avatar_cache_class_init (AvatarCacheClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->dispose = avatar_cache_dispose;
+  gobject_class->finalize = avatar_cache_finalize;
+
+  _signals[THUMBNAIL_READY] = g_signal_new ("thumbnail-ready",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST,
+      G_STRUCT_OFFSET (AvatarCacheClass, thumbnail_ready),
+      NULL, NULL,
+      g_cclosure_marshal_VOID__STRING,
+      G_TYPE_NONE,
+      1, G_TYPE_STRING);
+
+  g_type_class_add_private (gobject_class, sizeof (AvatarCachePrivate));
+}
+
+
+static void
+avatar_cache_init (AvatarCache *self)
+{
+  AvatarCachePrivate *priv = GET_PRIVATE (self);
+
+  priv->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) avatar_entry_free);
+  priv->thumbnails = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, g_object_unref);
+}
+
+
+AvatarCache *
+avatar_cache_new (GError **error)
+{
+  AvatarCache *self;
+  AvatarCachePrivate *priv;
+  char *dir;
+
+  dir = g_build_filename (g_get_user_cache_dir (), "telepathy-doc",
+      "avatars", NULL);
+
+  if (g_mkdir_with_parents (dir, 0700) != 0)
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+          "Could not create %s: %s", dir, g_strerror (errno));
+      g_free (dir);
+      return NULL;
+    }
+
+  self = g_object_new (TYPE_AVATAR_CACHE, NULL);
+  priv = GET_PRIVATE (self);
+
+  priv->dir = dir;
+  index_load (priv);
+
+  /* one thread is plenty, thumbnailing is only done once per avatar */
+  priv->thumbnailer = g_thread_pool_new (_make_thumbnail, NULL, 1, FALSE,
+      error);
+  if (priv->thumbnailer == NULL)
+    {
+      g_object_unref (self);
+      return NULL;
+    }
+
+  return self;
+}
+
+
+gboolean
+avatar_cache_has_avatar (AvatarCache *self,
+    const char *token)
+{
+  AvatarCachePrivate *priv = GET_PRIVATE (self);
+  guint32 flags;
+
+  return index_lookup (priv, token, &flags);
+}
+
+
+/* stores the avatar for @token, as retrieved from the CM, and queues a
+ * thumbnail of it to be made */
+void
+avatar_cache_store (AvatarCache *self,
+    const char *token,
+    const char *mime_type,
+    const GArray *avatar)
+{
+  AvatarCachePrivate *priv = GET_PRIVATE (self);
+  AvatarEntry *entry;
+  ThumbnailJob *job;
+  char *path;
+  GError *error = NULL;
+
+  g_return_if_fail (token != NULL && *token != '\0');
+
+  if (avatar_cache_has_avatar (self, token))
+    return;
+
+  path = avatar_path (priv, token, "");
+  if (!g_file_set_contents (path, avatar->data, avatar->len, &error))
+    {
+      g_warning ("Failed to store avatar: %s", error->message);
+      g_clear_error (&error);
+      g_free (path);
+      return;
+    }
+
+  entry = g_slice_new (AvatarEntry);
+  entry->mime_type = g_strdup (mime_type);
+  entry->size = avatar->len;
+  entry->flags = 0;
+  g_hash_table_insert (priv->entries, g_strdup (token), entry);
+
+  index_queue_save (self);
+
+  job = g_slice_new0 (ThumbnailJob);
+  job->self = g_object_ref (self);
+  job->token = g_strdup (token);
+  job->path = path;
+  job->thumbnail_path = avatar_path (priv, token, ".thumb.png");
+
+  g_thread_pool_push (priv->thumbnailer, job, NULL);
+}
+
+
+/* returns the thumbnail for @token, or NULL if it hasn't been made yet;
+ * thumbnails are only decoded the first time they're asked for */
+GdkPixbuf *
+avatar_cache_get_thumbnail (AvatarCache *self,
+    const char *token)
+{
+  AvatarCachePrivate *priv = GET_PRIVATE (self);
+  GdkPixbuf *pixbuf;
+  guint32 flags;
+  char *path;
+  GError *error = NULL;
+
+  pixbuf = g_hash_table_lookup (priv->thumbnails, token);
+  if (pixbuf != NULL)
+    return pixbuf;
+
+  if (!index_lookup (priv, token, &flags) ||
+      !(flags & AVATAR_HAS_THUMBNAIL))
+    return NULL;
+
+  path = avatar_path (priv, token, ".thumb.png");
+  pixbuf = gdk_pixbuf_new_from_file (path, &error);
+  g_free (path);
+
+  if (pixbuf == NULL)
+    {
+      g_warning ("Failed to load thumbnail: %s", error->message);
+      g_clear_error (&error);
+      return NULL;
+    }
+
+  g_hash_table_insert (priv->thumbnails, g_strdup (token), pixbuf);
+
+  return pixbuf;
+}
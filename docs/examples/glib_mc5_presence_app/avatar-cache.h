@@ -0,0 +1,48 @@
+#ifndef __AVATAR_CACHE_H__
+#define __AVATAR_CACHE_H__
+
+#include <glib-object.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_AVATAR_CACHE	(avatar_cache_get_type ())
+#define AVATAR_CACHE(obj)	(G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_AVATAR_CACHE, AvatarCache))
+#define AVATAR_CACHE_CLASS(obj)	(G_TYPE_CHECK_CLASS_CAST ((obj), TYPE_AVATAR_CACHE, AvatarCacheClass))
+#define IS_AVATAR_CACHE(obj)	(G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_AVATAR_CACHE))
+#define IS_AVATAR_CACHE_CLASS(obj)	(G_TYPE_CHECK_CLASS_TYPE ((obj), TYPE_AVATAR_CACHE))
+#define AVATAR_CACHE_GET_CLASS(obj)	(G_TYPE_INSTANCE_GET_CLASS ((obj), TYPE_AVATAR_CACHE, AvatarCacheClass))
+
+#define AVATAR_CACHE_THUMBNAIL_SIZE 48
+
+typedef struct _AvatarCache AvatarCache;
+typedef struct _AvatarCacheClass AvatarCacheClass;
+
+struct _AvatarCache
+{
+  GObject parent;
+};
+
+struct _AvatarCacheClass
+{
+  GObjectClass parent_class;
+
+  void (* thumbnail_ready) (AvatarCache *self,
+      const char *token);
+};
+
+GType avatar_cache_get_type (void);
+AvatarCache *avatar_cache_new (GError **error);
+
+gboolean avatar_cache_has_avatar (AvatarCache *self,
+    const char *token);
+void avatar_cache_store (AvatarCache *self,
+    const char *token,
+    const char *mime_type,
+    const GArray *avatar);
+GdkPixbuf *avatar_cache_get_thumbnail (AvatarCache *self,
+    const char *token);
+
+G_END_DECLS
+
+#endif
@@ -1,7 +1,54 @@
 #include <string.h>
 
+#include "avatar-cache.h"
 #include "connections-monitor.h"
+#include "contact-resolver.h"
+#include "presence-log.h"
+#include "roster-snapshot.h"
+#include "watchlist.h"
 
+#define CONTACTS_PER_REQUEST 100
+#define MAX_REQUESTS_IN_FLIGHT 4
+
+/* how often to log the transition counts, if they've changed */
+#define TRANSITION_COUNTS_INTERVAL 60
+
+typedef struct
+{
+  TpAccount *account;
+  TpConnection *conn;
+
+  /* watched contact id -> TpContact, for the contacts already resolved on
+   * this connection */
+  GHashTable *contacts;
+
+  /* handle -> the last TpConnectionPresenceType we saw for each contact */
+  GArray *types;
+
+  /* avatar tokens we've asked the CM for, and the AvatarRetrieved signal
+   * that will bring them */
+  GHashTable *requested_avatars;
+  TpProxySignalConnection *avatar_retrieved;
+} WatchedAccount;
+
+static Watchlist *watchlist = NULL;
+
+/* avatars by token, shared by every account; may be NULL */
+static AvatarCache *avatars = NULL;
+
+/* account name -> WatchedAccount, for each account with a connection */
+static GHashTable *watched_accounts = NULL;
+
+/* account name -> RosterSnapshot of the contacts we watched last time */
+static GHashTable *snapshots = NULL;
+
+/* every presence change we see is logged here, if --record was given; note
+ * that handles are only unique per connection */
+static PresenceRecorder *recorder = NULL;
+
+/* stands in for the account the log was recorded on, when replaying a log;
+ * only its presence types are used */
+static WatchedAccount *replayed_account = NULL;
 
 static const char *
 shorten_account_name (TpAccount *account)
@@ -11,64 +58,466 @@ shorten_account_name (TpAccount *account)
 }
 
 
+/* the transitions we report, and count */
+typedef enum
+{
+  TRANSITION_NONE,
+  TRANSITION_ONLINE,
+  TRANSITION_AWAY,
+  TRANSITION_OFFLINE,
+  NUM_TRANSITIONS
+} Transition;
+
+static const char *transition_names[NUM_TRANSITIONS] = {
+    "unchanged", "online", "away", "offline"
+};
+
+#define _ TRANSITION_NONE
+#define ON TRANSITION_ONLINE
+#define AW TRANSITION_AWAY
+#define OF TRANSITION_OFFLINE
+
+/* transitions[old type][new type]; a contact coming online from offline or
+ * away is reported as online, and a contact that was available or busy is
+ * reported as away or offline */
+static const guint8 transitions[NUM_TP_CONNECTION_PRESENCE_TYPES]
+                               [NUM_TP_CONNECTION_PRESENCE_TYPES] = {
+  /* UNSET OFFLINE AVAIL AWAY XA HIDDEN BUSY UNKNOWN ERROR */
+    { _,    _,      ON,   _,   _,  _,    ON,  _,      _ },  /* UNSET */
+    { _,    _,      ON,   _,   _,  _,    ON,  _,      _ },  /* OFFLINE */
+    { OF,   OF,     _,    AW,  AW, OF,   _,   OF,     OF }, /* AVAILABLE */
+    { _,    _,      ON,   _,   _,  _,    ON,  _,      _ },  /* AWAY */
+    { _,    _,      ON,   _,   _,  _,    ON,  _,      _ },  /* EXTENDED_AWAY */
+    { _,    _,      _,    _,   _,  _,    _,   _,      _ },  /* HIDDEN */
+    { OF,   OF,     _,    AW,  AW, OF,   _,   OF,     OF }, /* BUSY */
+    { _,    _,      ON,   _,   _,  _,    ON,  _,      _ },  /* UNKNOWN */
+    { _,    _,      ON,   _,   _,  _,    ON,  _,      _ },  /* ERROR */
+};
+
+#undef _
+#undef ON
+#undef AW
+#undef OF
+
+/* how many of each transition we've seen, see dump_transition_counts() */
+static guint64 transition_counts[NUM_TRANSITIONS] = { 0, };
+
+
+/* stores @type as the presence of @handle in @types, a dense array indexed
+ * by handle, and returns the presence it replaces */
+static TpConnectionPresenceType
+swap_presence_type (GArray *types,
+    TpHandle handle,
+    TpConnectionPresenceType type)
+{
+  TpConnectionPresenceType old_type;
+
+  /* the array zero-fills as it grows, and zero is
+   * TP_CONNECTION_PRESENCE_TYPE_UNSET */
+  if (handle >= types->len)
+    g_array_set_size (types, handle + 1);
+
+  old_type = g_array_index (types, guint8, handle);
+  g_array_index (types, guint8, handle) = type;
+
+  return old_type;
+}
+
+
+static GArray *
+presence_types_new (void)
+{
+  return g_array_new (FALSE, TRUE, sizeof (guint8));
+}
+
+
+static void
+report_presence_change (const char *alias,
+    TpConnectionPresenceType old_type,
+    TpConnectionPresenceType type)
+{
+  Transition transition = TRANSITION_NONE;
+
+  /* a type we don't know about is never reported */
+  if (old_type < NUM_TP_CONNECTION_PRESENCE_TYPES &&
+      type < NUM_TP_CONNECTION_PRESENCE_TYPES)
+    transition = transitions[old_type][type];
+
+  transition_counts[transition]++;
+
+  switch (transition)
+    {
+      case TRANSITION_ONLINE:
+        g_message ("%s is now online", alias);
+        break;
+
+      case TRANSITION_AWAY:
+        g_message ("%s is away", alias);
+        break;
+
+      case TRANSITION_OFFLINE:
+        g_message ("%s is now offline", alias);
+        break;
+
+      default:
+        break;
+    }
+}
+
+
+static void
+dump_transition_counts (void)
+{
+  guint64 total = 0;
+  guint i;
+
+  for (i = 0; i < NUM_TRANSITIONS; i++)
+    total += transition_counts[i];
+
+  g_message ("Presence transitions: %" G_GUINT64_FORMAT " events", total);
+
+  for (i = 0; i < NUM_TRANSITIONS; i++)
+    g_message ("  %-10s %" G_GUINT64_FORMAT " (%.1f%%)",
+        transition_names[i], transition_counts[i],
+        total > 0 ? 100.0 * transition_counts[i] / total : 0);
+}
+
+
+static gboolean
+_dump_transition_counts (gpointer user_data)
+{
+  static guint64 last_total = 0;
+  guint64 total = 0;
+  guint i;
+
+  for (i = 0; i < NUM_TRANSITIONS; i++)
+    total += transition_counts[i];
+
+  /* don't repeat ourselves while nothing is happening */
+  if (total != last_total)
+    dump_transition_counts ();
+
+  last_total = total;
+
+  return TRUE;
+}
+
+
+/* does the work of _contact_presence_changed, for the contact with @handle
+ * on @wa; a replayed log is fed through here too, so it exercises the same
+ * code as a live connection */
+static void
+contact_presence_changed (WatchedAccount *wa,
+    TpHandle handle,
+    const char *alias,
+    TpConnectionPresenceType type,
+    const char *status,
+    const char *message)
+{
+  g_debug ("Contact status changed: %s: %s", alias, status);
+
+  if (recorder != NULL)
+    {
+      /* each presence-changed signal is a batch of its own */
+      presence_recorder_begin_batch (recorder);
+      presence_recorder_record (recorder, handle, type, status, message);
+    }
+
+  report_presence_change (alias,
+      swap_presence_type (wa->types, handle, type),
+      type);
+}
+
+
 static void
 _contact_presence_changed (TpContact *contact,
     TpConnectionPresenceType type,
     const char *status,
     const char *message,
-    TpAccount *account)
-{
-  g_debug ("Contact status changed: %s: %s",
-      tp_contact_get_alias (contact),
-      status);
-
-  switch (GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (contact), "presence")))
-    {
-      case TP_CONNECTION_PRESENCE_TYPE_UNSET:
-      case TP_CONNECTION_PRESENCE_TYPE_OFFLINE:
-      case TP_CONNECTION_PRESENCE_TYPE_AWAY:
-      case TP_CONNECTION_PRESENCE_TYPE_EXTENDED_AWAY:
-      case TP_CONNECTION_PRESENCE_TYPE_UNKNOWN:
-      case TP_CONNECTION_PRESENCE_TYPE_ERROR:
-        /* contact was originally offline or away */
-        switch (type)
-          {
-            case TP_CONNECTION_PRESENCE_TYPE_AVAILABLE:
-            case TP_CONNECTION_PRESENCE_TYPE_BUSY:
-              /* contact is now available/busy */
-              g_message ("%s is now online", tp_contact_get_alias (contact));
-              break;
-
-            default:
-              break;
-          }
+    WatchedAccount *wa)
+{
+  contact_presence_changed (wa, tp_contact_get_handle (contact),
+      tp_contact_get_alias (contact), type, status, message);
+}
+
+
+/* feeds a recorded batch to contact_presence_changed(), as the
+ * presence-changed signals of each contact in it would */
+static void
+_replayed_presences_changed (TpConnection *conn,
+    GHashTable *presences,
+    gpointer user_data,
+    GObject *weak_obj)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, presences);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      TpHandle handle = GPOINTER_TO_UINT (key);
+      char alias[32];
+      guint type;
+      const char *status, *message;
+
+      tp_value_array_unpack (value, 3, &type, &status, &message);
+
+      /* the log doesn't have the contacts' aliases */
+      g_snprintf (alias, sizeof (alias), "handle %u", handle);
+      contact_presence_changed (replayed_account, handle, alias, type,
+          status, message);
+    }
+}
+
+
+static void
+_replay_done (PresenceReplayer *replayer,
+    guint n_events,
+    gdouble elapsed,
+    gpointer user_data)
+{
+  g_message ("Replayed %u presence changes in %.3fs (%.0f/s)",
+      n_events, elapsed, elapsed > 0 ? n_events / elapsed : 0);
+  dump_transition_counts ();
+
+  g_main_loop_quit (user_data);
+}
+
+
+/* replays a log written with --record; @speed is a multiple of the recorded
+ * speed, 0 replays as fast as possible */
+static int
+replay (const char *path,
+    gdouble speed)
+{
+  PresenceReplayer *replayer;
+  GMainLoop *loop;
+  GError *error = NULL;
+
+  replayer = presence_replayer_new (path, &error);
+  if (replayer == NULL)
+    g_error ("%s", error->message);
+
+  replayed_account = g_slice_new0 (WatchedAccount);
+  replayed_account->types = presence_types_new ();
+  loop = g_main_loop_new (NULL, FALSE);
+
+  presence_replayer_start (replayer, speed,
+      _replayed_presences_changed, _replay_done, loop);
+
+  g_main_loop_run (loop);
+
+  presence_replayer_free (replayer);
+  g_array_free (replayed_account->types, TRUE);
+  g_slice_free (WatchedAccount, replayed_account);
+  g_main_loop_unref (loop);
+
+  return 0;
+}
+
+
+static void
+show_snapshots (void)
+{
+  GList *accounts, *ptr;
+
+  accounts = watchlist_get_accounts (watchlist);
+
+  for (ptr = accounts; ptr != NULL; ptr = ptr->next)
+    {
+      const char *name = ptr->data;
+      RosterSnapshot *snapshot;
+      GError *error = NULL;
+      guint j;
+
+      snapshot = roster_snapshot_load (name, &error);
+      if (snapshot == NULL)
+        {
+          g_debug ("No cached contacts for %s: %s", name, error->message);
+          g_clear_error (&error);
+          continue;
+        }
+
+      g_hash_table_insert (snapshots, g_strdup (name), snapshot);
+
+      for (j = 0; j < roster_snapshot_get_n_entries (snapshot); j++)
+        {
+          RosterSnapshotEntry entry;
+
+          roster_snapshot_get_entry (snapshot, j, &entry);
+
+          g_message ("%s was last seen %s", entry.alias,
+              entry.presence_status);
+        }
+    }
+
+  g_list_free (accounts);
+}
+
+
+static void
+_snapshot_diff (RosterSnapshotChange change,
+    const RosterSnapshotEntry *entry,
+    TpContact *contact,
+    gpointer user_data)
+{
+  switch (change)
+    {
+      case ROSTER_SNAPSHOT_ADDED:
+        g_debug ("New contact: %s", tp_contact_get_identifier (contact));
         break;
 
-      case TP_CONNECTION_PRESENCE_TYPE_AVAILABLE:
-      case TP_CONNECTION_PRESENCE_TYPE_BUSY:
-        /* contact was originally available/busy */
-        switch (type)
-          {
-            case TP_CONNECTION_PRESENCE_TYPE_AWAY:
-            case TP_CONNECTION_PRESENCE_TYPE_EXTENDED_AWAY:
-              /* contact is now away */
-              g_message ("%s is away", tp_contact_get_alias (contact));
-              break;
-
-            case TP_CONNECTION_PRESENCE_TYPE_AVAILABLE:
-            case TP_CONNECTION_PRESENCE_TYPE_BUSY:
-              /* contact is still available/busy */
-              break;
-
-            default:
-              g_message ("%s is now offline", tp_contact_get_alias (contact));
-              break;
-          }
+      case ROSTER_SNAPSHOT_REMOVED:
+        g_debug ("Contact gone: %s", entry->identifier);
+        break;
+
+      case ROSTER_SNAPSHOT_CHANGED:
+        g_debug ("Contact changed since last run: %s: %s -> %s",
+            tp_contact_get_identifier (contact),
+            entry->presence_status,
+            tp_contact_get_presence_status (contact));
         break;
     }
 }
 
 
+/* returns whether we need to ask the CM for @contact's avatar, which is
+ * only the case if it has a token we've never seen */
+static gboolean
+contact_needs_avatar (WatchedAccount *wa,
+    TpContact *contact)
+{
+  const char *token = tp_contact_get_avatar_token (contact);
+
+  if (avatars == NULL || wa->avatar_retrieved == NULL ||
+      tp_str_empty (token) ||
+      avatar_cache_has_avatar (avatars, token) ||
+      g_hash_table_lookup (wa->requested_avatars, token) != NULL)
+    return FALSE;
+
+  g_hash_table_insert (wa->requested_avatars, g_strdup (token),
+      GUINT_TO_POINTER (TRUE));
+
+  return TRUE;
+}
+
+
+static void
+_request_avatars_cb (TpConnection *conn,
+    const GError *in_error,
+    gpointer user_data,
+    GObject *weak_obj)
+{
+  char **tokens = user_data;
+  GHashTableIter iter;
+  gpointer value;
+  guint i;
+
+  if (in_error == NULL)
+    return;
+
+  g_warning ("Failed to request avatars: %s", in_error->message);
+
+  /* forget that we asked, so the avatars are asked for again the next
+   * time their tokens are seen; if the account has reconnected since, its
+   * requests were forgotten with the old connection */
+  g_hash_table_iter_init (&iter, watched_accounts);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      WatchedAccount *wa = value;
+
+      if (wa->conn != conn)
+        continue;
+
+      for (i = 0; tokens[i] != NULL; i++)
+        g_hash_table_remove (wa->requested_avatars, tokens[i]);
+    }
+}
+
+
+/* asks the CM for the avatars of @contacts, a GPtrArray of TpContact that
+ * contact_needs_avatar() returned TRUE for */
+static void
+watched_account_request_avatars (WatchedAccount *wa,
+    GPtrArray *contacts)
+{
+  GArray *handles;
+  char **tokens;
+  guint i;
+
+  if (contacts->len == 0)
+    return;
+
+  g_debug ("Requesting %u avatars", contacts->len);
+
+  handles = g_array_sized_new (FALSE, FALSE, sizeof (TpHandle),
+      contacts->len);
+  tokens = g_new0 (char *, contacts->len + 1);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpContact *contact = g_ptr_array_index (contacts, i);
+      TpHandle handle = tp_contact_get_handle (contact);
+
+      g_array_append_val (handles, handle);
+      tokens[i] = g_strdup (tp_contact_get_avatar_token (contact));
+    }
+
+  /* the avatars arrive through AvatarRetrieved */
+  tp_cli_connection_interface_avatars_call_request_avatars (wa->conn, -1,
+      handles, _request_avatars_cb, tokens, (GDestroyNotify) g_strfreev,
+      NULL);
+
+  g_array_free (handles, TRUE);
+}
+
+
+static void
+_contact_avatar_token_changed (TpContact *contact,
+    GParamSpec *pspec,
+    WatchedAccount *wa)
+{
+  GPtrArray *contacts;
+
+  if (!contact_needs_avatar (wa, contact))
+    return;
+
+  contacts = g_ptr_array_new ();
+  g_ptr_array_add (contacts, contact);
+
+  watched_account_request_avatars (wa, contacts);
+
+  g_ptr_array_free (contacts, TRUE);
+}
+
+
+static void
+_avatar_retrieved (TpConnection *conn,
+    guint contact,
+    const char *token,
+    const GArray *avatar,
+    const char *mime_type,
+    gpointer user_data,
+    GObject *weak_obj)
+{
+  WatchedAccount *wa = user_data;
+
+  g_debug ("Retrieved avatar %s (%u bytes)", token, avatar->len);
+
+  avatar_cache_store (avatars, token, mime_type, avatar);
+  g_hash_table_remove (wa->requested_avatars, token);
+}
+
+
+static void
+_thumbnail_ready (AvatarCache *cache,
+    const char *token,
+    gpointer user_data)
+{
+  g_debug ("Thumbnail ready for avatar %s", token);
+}
+
+
 static void
 _got_contacts (TpConnection *conn,
     guint n_contacts,
@@ -79,6 +528,9 @@ _got_contacts (TpConnection *conn,
     gpointer user_data,
     GObject *account)
 {
+  WatchedAccount *wa;
+  const char *name;
+  GPtrArray *need_avatars;
   guint i;
 
   if (in_error != NULL)
@@ -89,85 +541,314 @@ _got_contacts (TpConnection *conn,
 
   g_debug ("Loaded %u contacts", n_contacts);
 
+  name = shorten_account_name (TP_ACCOUNT (account));
+  wa = g_hash_table_lookup (watched_accounts, name);
+
+  /* the account has reconnected since these contacts were requested */
+  if (wa == NULL || wa->conn != conn)
+    return;
+
+  need_avatars = g_ptr_array_new ();
+
   for (i = 0; i < n_contacts; i++)
     {
       TpContact *contact = contacts[i];
 
+      /* the contact was removed from the watchlist while we were
+       * resolving it */
+      if (!watchlist_contains (watchlist, name, requested_ids[i]))
+        continue;
+
+      g_hash_table_insert (wa->contacts, g_strdup (requested_ids[i]),
+          g_object_ref (contact));
+
+      if (watchlist_count_accounts (watchlist, requested_ids[i]) > 1)
+        g_debug ("%s is watched on more than one account", requested_ids[i]);
+
       _contact_presence_changed (contact,
           tp_contact_get_presence_type (contact),
           tp_contact_get_presence_status (contact),
           tp_contact_get_presence_message (contact),
-          TP_ACCOUNT (account));
+          wa);
 
+      /* the handlers are disconnected before wa is freed */
       g_signal_connect (contact, "presence-changed",
-          G_CALLBACK (_contact_presence_changed), account);
+          G_CALLBACK (_contact_presence_changed), wa);
+      g_signal_connect (contact, "notify::avatar-token",
+          G_CALLBACK (_contact_avatar_token_changed), wa);
+
+      if (contact_needs_avatar (wa, contact))
+        g_ptr_array_add (need_avatars, contact);
     }
+
+  /* one request for all of this chunk's new avatars */
+  watched_account_request_avatars (wa, need_avatars);
+  g_ptr_array_free (need_avatars, TRUE);
 }
 
 
 static void
-_got_connection (ConnectionsMonitor *monitor,
-    TpAccount *account,
-    TpConnection *conn,
-    GKeyFile *keyfile)
+_got_all_contacts (ContactResolver *resolver,
+    guint n_contacts,
+    TpContact * const *contacts,
+    const GError *in_error,
+    gpointer account)
+{
+  WatchedAccount *wa;
+  const char *name;
+  GPtrArray *all;
+  GHashTableIter iter;
+  gpointer contact;
+  GError *error = NULL;
+
+  g_debug ("Loaded %u contacts, first contact after %.3fs",
+      n_contacts, contact_resolver_get_time_to_first_contact (resolver));
+
+  name = shorten_account_name (TP_ACCOUNT (account));
+  wa = g_hash_table_lookup (watched_accounts, name);
+  if (wa == NULL)
+    return;
+
+  /* reconcile the cached contacts with every contact we're watching on this
+   * connection, and cache them for next time */
+  all = g_ptr_array_sized_new (g_hash_table_size (wa->contacts));
+
+  g_hash_table_iter_init (&iter, wa->contacts);
+  while (g_hash_table_iter_next (&iter, NULL, &contact))
+    g_ptr_array_add (all, contact);
+
+  roster_snapshot_diff (g_hash_table_lookup (snapshots, name),
+      (TpContact * const *) all->pdata, all->len, _snapshot_diff, NULL);
+
+  if (!roster_snapshot_save (name,
+        (TpContact * const *) all->pdata, all->len, &error))
+    {
+      g_warning ("%s", error->message);
+      g_clear_error (&error);
+    }
+
+  g_ptr_array_free (all, TRUE);
+}
+
+
+static void
+watched_account_resolve (WatchedAccount *wa,
+    const char * const *ids)
 {
   TpContactFeature features[] = {
       TP_CONTACT_FEATURE_ALIAS,
       TP_CONTACT_FEATURE_AVATAR_TOKEN,
       TP_CONTACT_FEATURE_PRESENCE
   };
-  char **contacts;
-  GError *error = NULL;
-  gsize length;
+  ContactResolver *resolver;
+  GPtrArray *unresolved;
+  guint i;
 
-  if (!g_key_file_has_key (keyfile,
-        shorten_account_name (account), "contacts",
-        NULL))
-    return;
+  /* only ask for the contacts we haven't already got */
+  unresolved = g_ptr_array_new ();
 
-  contacts = g_key_file_get_string_list (keyfile,
-      shorten_account_name (account), "contacts",
-      &length, &error);
-  if (error != NULL)
+  for (i = 0; ids[i] != NULL; i++)
     {
-      g_warning ("%s", error->message);
-      return;
+      if (g_hash_table_lookup (wa->contacts, ids[i]) == NULL)
+        g_ptr_array_add (unresolved, (char *) ids[i]);
     }
 
-  tp_connection_get_contacts_by_id (conn,
-      length, (const gchar * const*) contacts,
-      G_N_ELEMENTS (features), features,
-      _got_contacts, NULL, NULL, G_OBJECT (account));
+  if (unresolved->len > 0)
+    {
+      /* resolve the contacts a chunk at a time, so we can start reporting
+       * presence before the whole list is resolved */
+      resolver = contact_resolver_new (wa->conn,
+          G_N_ELEMENTS (features), features,
+          CONTACTS_PER_REQUEST, MAX_REQUESTS_IN_FLIGHT);
+
+      contact_resolver_get_contacts_by_id (resolver,
+          unresolved->len, (const char * const *) unresolved->pdata,
+          _got_contacts, _got_all_contacts,
+          wa->account, G_OBJECT (wa->account));
+    }
+
+  g_ptr_array_free (unresolved, TRUE);
+}
+
+
+static void
+watched_account_free (WatchedAccount *wa)
+{
+  GHashTableIter iter;
+  gpointer contact;
+
+  g_hash_table_iter_init (&iter, wa->contacts);
+  while (g_hash_table_iter_next (&iter, NULL, &contact))
+    {
+      g_signal_handlers_disconnect_by_func (contact,
+          _contact_presence_changed, wa);
+      g_signal_handlers_disconnect_by_func (contact,
+          _contact_avatar_token_changed, wa);
+    }
+
+  if (wa->avatar_retrieved != NULL)
+    tp_proxy_signal_connection_disconnect (wa->avatar_retrieved);
+
+  g_hash_table_destroy (wa->contacts);
+  g_hash_table_destroy (wa->requested_avatars);
+  g_array_free (wa->types, TRUE);
+  g_object_unref (wa->conn);
+  g_object_unref (wa->account);
+
+  g_slice_free (WatchedAccount, wa);
+}
+
+
+static void
+_got_connection (ConnectionsMonitor *monitor,
+    TpAccount *account,
+    TpConnection *conn,
+    gpointer user_data)
+{
+  const char *name = shorten_account_name (account);
+  WatchedAccount *wa;
+  char **contacts;
+
+  contacts = watchlist_dup_contacts (watchlist, name);
+
+  /* this replaces any state for the account's previous connection */
+  wa = g_slice_new0 (WatchedAccount);
+  wa->account = g_object_ref (account);
+  wa->conn = g_object_ref (conn);
+  wa->contacts = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, g_object_unref);
+  wa->types = presence_types_new ();
+  wa->requested_avatars = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
+
+  if (avatars != NULL && tp_proxy_has_interface_by_id (conn,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS))
+    wa->avatar_retrieved =
+      tp_cli_connection_interface_avatars_connect_to_avatar_retrieved (
+          conn, _avatar_retrieved, wa, NULL, NULL, NULL);
+
+  g_hash_table_insert (watched_accounts, g_strdup (name), wa);
+
+  watched_account_resolve (wa, (const char * const *) contacts);
 
   g_strfreev (contacts);
 }
 
 
+static void
+_watchlist_changed (Watchlist *self,
+    const char *account,
+    const char * const *added,
+    const char * const *removed,
+    gpointer user_data)
+{
+  WatchedAccount *wa;
+  guint i;
+
+  /* accounts that aren't connected will pick up the new watchlist when
+   * they connect */
+  wa = g_hash_table_lookup (watched_accounts, account);
+  if (wa == NULL)
+    return;
+
+  for (i = 0; removed[i] != NULL; i++)
+    {
+      TpContact *contact = g_hash_table_lookup (wa->contacts, removed[i]);
+
+      if (contact == NULL)
+        continue;
+
+      g_signal_handlers_disconnect_by_func (contact,
+          _contact_presence_changed, wa);
+      g_signal_handlers_disconnect_by_func (contact,
+          _contact_avatar_token_changed, wa);
+
+      /* if the contact is watched again, report it as though it's new */
+      swap_presence_type (wa->types, tp_contact_get_handle (contact),
+          TP_CONNECTION_PRESENCE_TYPE_UNSET);
+
+      g_hash_table_remove (wa->contacts, removed[i]);
+    }
+
+  watched_account_resolve (wa, added);
+}
+
+
 int
 main (int argc,
     const char **argv)
 {
-  GKeyFile *keyfile;
   ConnectionsMonitor *monitor;
   GMainLoop *loop;
   GError *error = NULL;
 
+  /* avatar thumbnails are made in a worker thread */
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
+
   g_type_init ();
 
-  keyfile = g_key_file_new ();
-  if (!g_key_file_load_from_file (keyfile, argv[1], G_KEY_FILE_NONE, &error))
+  /* example WATCHLIST [--record LOG]
+   * example --replay LOG [SPEED] */
+  if (argc >= 3 && !tp_strdiff (argv[1], "--replay"))
+    return replay (argv[2], argc > 3 ? g_ascii_strtod (argv[3], NULL) : 1);
+
+  if (argc == 4 && !tp_strdiff (argv[2], "--record"))
+    {
+      recorder = presence_recorder_new (argv[3], &error);
+      if (recorder == NULL)
+        g_error ("%s", error->message);
+    }
+
+  avatars = avatar_cache_new (&error);
+  if (avatars == NULL)
+    {
+      g_warning ("Not caching avatars: %s", error->message);
+      g_clear_error (&error);
+    }
+  else
+    {
+      g_signal_connect (avatars, "thumbnail-ready",
+          G_CALLBACK (_thumbnail_ready), NULL);
+    }
+
+  /* the watchlist is loaded once, and reloaded whenever the file changes */
+  watchlist = watchlist_new (argv[1], &error);
+  if (watchlist == NULL)
     g_error ("%s", error->message);
 
+  g_signal_connect (watchlist, "changed",
+      G_CALLBACK (_watchlist_changed), NULL);
+
+  watched_accounts = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) watched_account_free);
+
+  /* show the contacts we saw last time while we wait for the accounts */
+  snapshots = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) roster_snapshot_free);
+  show_snapshots ();
+
   monitor = connections_monitor_new ();
   g_signal_connect (monitor, "connection",
-      G_CALLBACK (_got_connection), keyfile);
+      G_CALLBACK (_got_connection), NULL);
 
   loop = g_main_loop_new (NULL, FALSE);
 
+  g_timeout_add_seconds (TRANSITION_COUNTS_INTERVAL,
+      _dump_transition_counts, NULL);
+
   /* run the program */
   g_main_loop_run (loop);
 
   g_main_loop_unref (loop);
   g_object_unref (monitor);
-  g_key_file_free (keyfile);
+  g_hash_table_destroy (watched_accounts);
+  g_object_unref (watchlist);
+  tp_clear_object (&avatars);
+  g_hash_table_destroy (snapshots);
+
+  if (recorder != NULL)
+    presence_recorder_free (recorder);
+
+  return 0;
 }
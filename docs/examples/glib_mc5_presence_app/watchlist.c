@@ -0,0 +1,390 @@
+#include <gio/gio.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "watchlist.h"
+#include "marshallers.h"
+
+#define GET_PRIVATE(obj)  (G_TYPE_INSTANCE_GET_PRIVATE ((obj), TYPE_WATCHLIST, WatchlistPrivate))
+
+G_DEFINE_TYPE (Watchlist, watchlist, G_TYPE_OBJECT);
+
+enum /* signals */
+{
+  CHANGED,
+  LAST_SIGNAL
+};
+
+static guint _signals[LAST_SIGNAL] = { 0, };
+
+typedef struct _WatchlistPrivate WatchlistPrivate;
+struct _WatchlistPrivate
+{
+  char *path;
+  GFileMonitor *monitor;
+
+  /* account name -> set of contact ids */
+  GHashTable *accounts;
+  /* contact id -> number of accounts watching it */
+  GHashTable *ids;
+};
+
+
+static GHashTable *
+load_accounts (const char *path,
+    GError **error)
+{
+  GKeyFile *keyfile;
+  GHashTable *accounts = NULL;
+  char **groups;
+  guint i;
+
+  keyfile = g_key_file_new ();
+  if (!g_key_file_load_from_file (keyfile, path, G_KEY_FILE_NONE, error))
+    goto finally;
+
+  accounts = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_hash_table_destroy);
+
+  groups = g_key_file_get_groups (keyfile, NULL);
+
+  for (i = 0; groups[i] != NULL; i++)
+    {
+      GHashTable *set;
+      char **contacts;
+      guint j;
+
+      contacts = g_key_file_get_string_list (keyfile, groups[i], "contacts",
+          NULL, NULL);
+      if (contacts == NULL)
+        continue;
+
+      /* a contact listed twice only ends up in the set once */
+      set = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+      for (j = 0; contacts[j] != NULL; j++)
+        g_hash_table_insert (set, g_strdup (contacts[j]),
+            GUINT_TO_POINTER (TRUE));
+
+      g_hash_table_insert (accounts, g_strdup (groups[i]), set);
+
+      g_strfreev (contacts);
+    }
+
+  g_strfreev (groups);
+
+finally:
+  g_key_file_free (keyfile);
+
+  return accounts;
+}
+
+
+static void
+ref_id (WatchlistPrivate *priv,
+    const char *id)
+{
+  guint count = GPOINTER_TO_UINT (g_hash_table_lookup (priv->ids, id));
+
+  g_hash_table_insert (priv->ids, g_strdup (id),
+      GUINT_TO_POINTER (count + 1));
+}
+
+
+static void
+unref_id (WatchlistPrivate *priv,
+    const char *id)
+{
+  guint count = GPOINTER_TO_UINT (g_hash_table_lookup (priv->ids, id));
+
+  if (count > 1)
+    g_hash_table_insert (priv->ids, g_strdup (id),
+        GUINT_TO_POINTER (count - 1));
+  else
+    g_hash_table_remove (priv->ids, id);
+}
+
+
+/* counts every account's ids, when the watchlist is first loaded; reloads
+ * only adjust the counts of the ids that changed */
+static void
+count_ids (WatchlistPrivate *priv)
+{
+  GHashTableIter iter;
+  gpointer set;
+
+  g_hash_table_iter_init (&iter, priv->accounts);
+  while (g_hash_table_iter_next (&iter, NULL, &set))
+    {
+      GHashTableIter set_iter;
+      gpointer id;
+
+      g_hash_table_iter_init (&set_iter, set);
+      while (g_hash_table_iter_next (&set_iter, &id, NULL))
+        ref_id (priv, id);
+    }
+}
+
+
+static GPtrArray *
+set_difference (GHashTable *a,
+    GHashTable *b)
+{
+  GPtrArray *diff = g_ptr_array_new ();
+  GHashTableIter iter;
+  gpointer id;
+
+  if (a != NULL)
+    {
+      g_hash_table_iter_init (&iter, a);
+      while (g_hash_table_iter_next (&iter, &id, NULL))
+        {
+          if (b == NULL || g_hash_table_lookup (b, id) == NULL)
+            g_ptr_array_add (diff, id);
+        }
+    }
+
+  g_ptr_array_add (diff, NULL);
+
+  return diff;
+}
+
+
+static void
+emit_changes (Watchlist *self,
+    const char *account,
+    GHashTable *old_set,
+    GHashTable *new_set)
+{
+  WatchlistPrivate *priv = GET_PRIVATE (self);
+  GPtrArray *added = set_difference (new_set, old_set);
+  GPtrArray *removed = set_difference (old_set, new_set);
+  guint i;
+
+  /* both arrays are NULL-terminated */
+  if (added->len > 1 || removed->len > 1)
+    {
+      for (i = 0; i < added->len - 1; i++)
+        ref_id (priv, g_ptr_array_index (added, i));
+
+      for (i = 0; i < removed->len - 1; i++)
+        unref_id (priv, g_ptr_array_index (removed, i));
+
+      g_debug ("Watchlist for %s: %u added, %u removed", account,
+          added->len - 1, removed->len - 1);
+
+      g_signal_emit (self, _signals[CHANGED], 0, account,
+          added->pdata, removed->pdata);
+    }
+
+  g_ptr_array_free (added, TRUE);
+  g_ptr_array_free (removed, TRUE);
+}
+
+
+static void
+watchlist_reload (Watchlist *self)
+{
+  WatchlistPrivate *priv = GET_PRIVATE (self);
+  GHashTable *old_accounts, *new_accounts;
+  GHashTableIter iter;
+  gpointer account, set;
+  GError *error = NULL;
+
+  new_accounts = load_accounts (priv->path, &error);
+  if (new_accounts == NULL)
+    {
+      /* keep the watchlist we have, the file may be mid-edit */
+      g_warning ("Failed to reload %s: %s", priv->path, error->message);
+      g_clear_error (&error);
+      return;
+    }
+
+  /* swap in the new watchlist first, so that handlers of the changed
+   * signal see the new state; each account's counts are updated before
+   * its signal is emitted */
+  old_accounts = priv->accounts;
+  priv->accounts = new_accounts;
+
+  g_hash_table_iter_init (&iter, new_accounts);
+  while (g_hash_table_iter_next (&iter, &account, &set))
+    emit_changes (self, account,
+        g_hash_table_lookup (old_accounts, account), set);
+
+  g_hash_table_iter_init (&iter, old_accounts);
+  while (g_hash_table_iter_next (&iter, &account, &set))
+    {
+      if (g_hash_table_lookup (new_accounts, account) == NULL)
+        emit_changes (self, account, set, NULL);
+    }
+
+  g_hash_table_destroy (old_accounts);
+}
+
+
+static void
+_file_changed (GFileMonitor *monitor,
+    GFile *file,
+    GFile *other_file,
+    GFileMonitorEvent event_type,
+    gpointer user_data)
+{
+  Watchlist *self = user_data;
+
+  /* only reload once the file has been completely written */
+  if (event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT ||
+      event_type == G_FILE_MONITOR_EVENT_CREATED)
+    watchlist_reload (self);
+}
+
+
+static void
+watchlist_finalize (GObject *self)
+{
+  WatchlistPrivate *priv = GET_PRIVATE (self);
+
+  if (priv->monitor != NULL)
+    {
+      g_file_monitor_cancel (priv->monitor);
+      g_signal_handlers_disconnect_by_func (priv->monitor,
+          _file_changed, self);
+      tp_clear_object (&priv->monitor);
+    }
+
+  tp_clear_pointer (&priv->accounts, g_hash_table_destroy);
+  tp_clear_pointer (&priv->ids, g_hash_table_destroy);
+  g_free (priv->path);
+
+  G_OBJECT_CLASS (watchlist_parent_class)->finalize (self);
+}
+
+
+static void
+watchlist_class_init (WatchlistClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = watchlist_finalize;
+
+  _signals[CHANGED] = g_signal_new ("changed",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST,
+      G_STRUCT_OFFSET (WatchlistClass, changed),
+      NULL, NULL,
+      _example_VOID__STRING_BOXED_BOXED,
+      G_TYPE_NONE,
+      3, G_TYPE_STRING,
+      G_TYPE_STRV | G_SIGNAL_TYPE_STATIC_SCOPE,
+      G_TYPE_STRV | G_SIGNAL_TYPE_STATIC_SCOPE);
+
+  g_type_class_add_private (gobject_class, sizeof (WatchlistPrivate));
+}
+
+
+static void
+watchlist_init (Watchlist *self)
+{
+  WatchlistPrivate *priv = GET_PRIVATE (self);
+
+  priv->ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+}
+
+
+Watchlist *
+watchlist_new (const char *path,
+    GError **error)
+{
+  Watchlist *self;
+  WatchlistPrivate *priv;
+  GFile *file;
+
+  self = g_object_new (TYPE_WATCHLIST, NULL);
+  priv = GET_PRIVATE (self);
+
+  priv->path = g_strdup (path);
+  priv->accounts = load_accounts (path, error);
+  if (priv->accounts == NULL)
+    goto error;
+
+  count_ids (priv);
+
+  /* watch the file for changes; on Linux GFileMonitor uses inotify */
+  file = g_file_new_for_path (path);
+  priv->monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL,
+      error);
+  g_object_unref (file);
+
+  if (priv->monitor == NULL)
+    goto error;
+
+  g_signal_connect (priv->monitor, "changed",
+      G_CALLBACK (_file_changed), self);
+
+  return self;
+
+error:
+  g_object_unref (self);
+
+  return NULL;
+}
+
+
+/* returns a list of account names borrowed from the watchlist,
+ * free with g_list_free() */
+GList *
+watchlist_get_accounts (Watchlist *self)
+{
+  WatchlistPrivate *priv = GET_PRIVATE (self);
+
+  return g_hash_table_get_keys (priv->accounts);
+}
+
+
+/* returns the contact ids watched on @account, free with g_strfreev() */
+char **
+watchlist_dup_contacts (Watchlist *self,
+    const char *account)
+{
+  WatchlistPrivate *priv = GET_PRIVATE (self);
+  GHashTable *set;
+  GHashTableIter iter;
+  gpointer id;
+  char **contacts;
+  guint i = 0;
+
+  set = g_hash_table_lookup (priv->accounts, account);
+  if (set == NULL)
+    return g_new0 (char *, 1);
+
+  contacts = g_new0 (char *, g_hash_table_size (set) + 1);
+
+  g_hash_table_iter_init (&iter, set);
+  while (g_hash_table_iter_next (&iter, &id, NULL))
+    contacts[i++] = g_strdup (id);
+
+  return contacts;
+}
+
+
+gboolean
+watchlist_contains (Watchlist *self,
+    const char *account,
+    const char *id)
+{
+  WatchlistPrivate *priv = GET_PRIVATE (self);
+  GHashTable *set;
+
+  set = g_hash_table_lookup (priv->accounts, account);
+
+  return set != NULL && g_hash_table_lookup (set, id) != NULL;
+}
+
+
+/* returns how many accounts are watching @id */
+guint
+watchlist_count_accounts (Watchlist *self,
+    const char *id)
+{
+  WatchlistPrivate *priv = GET_PRIVATE (self);
+
+  return GPOINTER_TO_UINT (g_hash_table_lookup (priv->ids, id));
+}
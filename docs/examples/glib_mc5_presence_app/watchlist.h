@@ -0,0 +1,48 @@
+#ifndef __WATCHLIST_H__
+#define __WATCHLIST_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define TYPE_WATCHLIST	(watchlist_get_type ())
+#define WATCHLIST(obj)	(G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_WATCHLIST, Watchlist))
+#define WATCHLIST_CLASS(obj)	(G_TYPE_CHECK_CLASS_CAST ((obj), TYPE_WATCHLIST, WatchlistClass))
+#define IS_WATCHLIST(obj)	(G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_WATCHLIST))
+#define IS_WATCHLIST_CLASS(obj)	(G_TYPE_CHECK_CLASS_TYPE ((obj), TYPE_WATCHLIST))
+#define WATCHLIST_GET_CLASS(obj)	(G_TYPE_INSTANCE_GET_CLASS ((obj), TYPE_WATCHLIST, WatchlistClass))
+
+typedef struct _Watchlist Watchlist;
+typedef struct _WatchlistClass WatchlistClass;
+
+struct _Watchlist
+{
+  GObject parent;
+};
+
+struct _WatchlistClass
+{
+  GObjectClass parent_class;
+
+  void (* changed) (Watchlist *self,
+      const char *account,
+      const char * const *added,
+      const char * const *removed);
+};
+
+GType watchlist_get_type (void);
+Watchlist *watchlist_new (const char *path,
+    GError **error);
+
+GList *watchlist_get_accounts (Watchlist *self);
+char **watchlist_dup_contacts (Watchlist *self,
+    const char *account);
+gboolean watchlist_contains (Watchlist *self,
+    const char *account,
+    const char *id);
+guint watchlist_count_accounts (Watchlist *self,
+    const char *id);
+
+G_END_DECLS
+
+#endif
@@ -7,11 +7,13 @@
  *    Danielle Madeley <danielle.madeley@collabora.co.uk>
  */
 
+#include <string.h>
+
 #include <telepathy-glib/enums.h>
-#include <telepathy-glib/gtypes.h>
 #include <telepathy-glib/interfaces.h>
 
 #include "presence-chooser.h"
+#include "status-cache.h"
 
 #define GET_PRIVATE(obj)  (G_TYPE_INSTANCE_GET_PRIVATE ((obj), TYPE_PRESENCE_CHOOSER, PresenceChooserPrivate))
 
@@ -25,6 +27,10 @@ struct _PresenceChooserPrivate
 {
   TpAccount *account;
   GtkListStore *store;
+
+  /* the StatusSpecs in the store, sorted by status, as given to us by
+   * status_cache_get_statuses() */
+  GPtrArray *specs;
 };
 
 enum /* properties */
@@ -85,48 +91,93 @@ presence_chooser_set_property (GObject      *self,
 
 static void
 presence_chooser_set_statuses (PresenceChooser *self,
-                               GHashTable      *statuses)
+                               GPtrArray       *specs)
 {
   g_return_if_fail (IS_PRESENCE_CHOOSER (self));
-  g_return_if_fail (statuses != NULL);
+  g_return_if_fail (specs != NULL);
 
   PresenceChooserPrivate *priv = GET_PRIVATE (self);
 
-  gtk_list_store_clear (priv->store);
+  /* every account on this protocol shares the same specs, so there's
+   * nothing to do if we reconnected to the same protocol */
+  if (specs == priv->specs) return;
 
-  GHashTableIter iter;
-  gpointer k, v;
+  /* both the store and the specs are sorted by status, so merge the specs
+   * into the store, only touching the rows that change */
+  GtkTreeModel *model = GTK_TREE_MODEL (priv->store);
+  GtkTreeIter iter;
+  gboolean valid = gtk_tree_model_get_iter_first (model, &iter);
+  gint position = 0;
+  guint i = 0;
 
-  g_hash_table_iter_init (&iter, statuses);
-  while (g_hash_table_iter_next (&iter, &k, &v))
+  while (valid || i < specs->len)
     {
-      char *status = k;
-      GValueArray *array = v;
-
+      StatusSpec *spec = i < specs->len ? g_ptr_array_index (specs, i) : NULL;
+      char *status = NULL;
       guint type;
-      gboolean set_on_self, can_have_message;
-
-      tp_value_array_unpack (array, 3,
-          &type, &set_on_self, &can_have_message);
+      gboolean can_have_message;
+      int cmp;
+
+      if (valid)
+        gtk_tree_model_get (model, &iter,
+            PRESENCE_TYPE, &type,
+            STATUS, &status,
+            CAN_HAVE_MESSAGE, &can_have_message,
+            -1);
+
+      if (!valid) cmp = 1;
+      else if (spec == NULL) cmp = -1;
+      else cmp = strcmp (status, spec->status);
+
+      if (cmp < 0)
+        {
+          /* the status has gone */
+          valid = gtk_list_store_remove (priv->store, &iter);
+        }
+      else if (cmp > 0)
+        {
+          /* a new status, list store iters persist, so @iter is still
+           * valid after inserting before it */
+          gtk_list_store_insert_with_values (priv->store, NULL, position,
+              ICON_NAME, presence_icons[spec->type],
+              PRESENCE_TYPE, spec->type,
+              STATUS, spec->status,
+              CAN_HAVE_MESSAGE, spec->can_have_message,
+              STATUS_MESSAGE, spec->status,
+              -1);
+
+          position++;
+          i++;
+        }
+      else
+        {
+          if (type != spec->type ||
+              can_have_message != spec->can_have_message)
+            gtk_list_store_set (priv->store, &iter,
+                ICON_NAME, presence_icons[spec->type],
+                PRESENCE_TYPE, spec->type,
+                CAN_HAVE_MESSAGE, spec->can_have_message,
+                -1);
+
+          valid = gtk_tree_model_iter_next (model, &iter);
+          position++;
+          i++;
+        }
+
+      g_free (status);
+    }
 
-      if (!set_on_self) continue;
+  if (priv->specs != NULL)
+    g_ptr_array_unref (priv->specs);
 
-      gtk_list_store_insert_with_values (priv->store, NULL, -1,
-          ICON_NAME, presence_icons[type],
-          PRESENCE_TYPE, type,
-          STATUS, status,
-          CAN_HAVE_MESSAGE, can_have_message,
-          STATUS_MESSAGE, status,
-          -1);
-    }
+  priv->specs = g_ptr_array_ref (specs);
 }
 
 static void
-_get_property_statuses (TpProxy      *conn,
-                        const GValue *value,
-                        const GError *error,
-                        gpointer      user_data,
-                        GObject      *self)
+_got_statuses (GPtrArray    *specs,
+               const GError *error,
+               gpointer      user_data,
+               GObject      *self)
 {
   if (error != NULL)
     {
@@ -134,10 +185,7 @@ _get_property_statuses (TpProxy      *conn,
       return;
     }
 
-  g_return_if_fail (G_VALUE_HOLDS (value, TP_HASH_TYPE_SIMPLE_STATUS_SPEC_MAP));
-
-  GHashTable *statuses = g_value_get_boxed (value);
-  presence_chooser_set_statuses (PRESENCE_CHOOSER (self), statuses);
+  presence_chooser_set_statuses (PRESENCE_CHOOSER (self), specs);
 }
 
 static void
@@ -154,12 +202,11 @@ _connection_ready (TpConnection *conn,
   if (tp_proxy_has_interface (conn,
         TP_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE))
     {
-      /* request the Statuses property */
-      tp_cli_dbus_properties_call_get (conn, -1,
-          TP_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE,
-          "Statuses",
-          _get_property_statuses,
-          NULL, NULL, G_OBJECT (self));
+      PresenceChooserPrivate *priv = GET_PRIVATE (self);
+
+      /* the statuses are only fetched once for each CM and protocol */
+      status_cache_get_statuses (priv->account, conn,
+          _got_statuses, NULL, G_OBJECT (self));
     }
 }
 
@@ -204,6 +251,12 @@ presence_chooser_dispose (GObject *self)
       priv->account = NULL;
     }
 
+  if (priv->specs != NULL)
+    {
+      g_ptr_array_unref (priv->specs);
+      priv->specs = NULL;
+    }
+
   G_OBJECT_CLASS (presence_chooser_parent_class)->dispose (self);
 }
 
@@ -0,0 +1,209 @@
+/*
+ * status-cache.c
+ *
+ * Shared SimplePresence statuses for each CM and protocol
+ */
+
+#include <string.h>
+
+#include <telepathy-glib/gtypes.h>
+#include <telepathy-glib/interfaces.h>
+#include <telepathy-glib/util.h>
+
+#include "status-cache.h"
+
+/* The statuses a connection supports are fixed by its CM and protocol, so
+ * they're only fetched for the first connection of each, and every account
+ * on that protocol shares the same StatusSpecs. */
+
+typedef struct _Waiter Waiter;
+struct _Waiter
+{
+  StatusCacheCallback callback;
+  gpointer user_data;
+  GObject *weak_object;
+};
+
+typedef struct _CacheEntry CacheEntry;
+struct _CacheEntry
+{
+  char *key;
+
+  /* NULL while the Statuses property is being fetched */
+  GPtrArray *specs;
+
+  /* Waiters for the fetch to finish */
+  GSList *waiters;
+};
+
+/* "cm/protocol" -> CacheEntry */
+static GHashTable *cache = NULL;
+
+static void
+status_spec_free (StatusSpec *spec)
+{
+  g_free (spec->status);
+  g_slice_free (StatusSpec, spec);
+}
+
+static gint
+status_spec_compare (gconstpointer a,
+                     gconstpointer b)
+{
+  const StatusSpec *spec_a = *(const StatusSpec **) a;
+  const StatusSpec *spec_b = *(const StatusSpec **) b;
+
+  return strcmp (spec_a->status, spec_b->status);
+}
+
+static GPtrArray *
+status_specs_new (GHashTable *statuses)
+{
+  GPtrArray *specs = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) status_spec_free);
+  GHashTableIter iter;
+  gpointer k, v;
+
+  g_hash_table_iter_init (&iter, statuses);
+  while (g_hash_table_iter_next (&iter, &k, &v))
+    {
+      guint type;
+      gboolean set_on_self, can_have_message;
+
+      tp_value_array_unpack (v, 3,
+          &type, &set_on_self, &can_have_message);
+
+      if (!set_on_self) continue;
+
+      StatusSpec *spec = g_slice_new (StatusSpec);
+      spec->status = g_strdup (k);
+      spec->type = type;
+      spec->can_have_message = can_have_message;
+
+      g_ptr_array_add (specs, spec);
+    }
+
+  g_ptr_array_sort (specs, status_spec_compare);
+
+  return specs;
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+  g_free (entry->key);
+
+  if (entry->specs != NULL)
+    g_ptr_array_unref (entry->specs);
+
+  g_slice_free (CacheEntry, entry);
+}
+
+static void
+cache_entry_notify (CacheEntry   *entry,
+                    const GError *error)
+{
+  GSList *waiters = g_slist_reverse (entry->waiters);
+  GSList *ptr;
+
+  entry->waiters = NULL;
+
+  for (ptr = waiters; ptr != NULL; ptr = ptr->next)
+    {
+      Waiter *waiter = ptr->data;
+
+      if (waiter->weak_object != NULL)
+        {
+          g_object_remove_weak_pointer (waiter->weak_object,
+              (gpointer *) &waiter->weak_object);
+
+          waiter->callback (entry->specs, error, waiter->user_data,
+              waiter->weak_object);
+        }
+
+      g_slice_free (Waiter, waiter);
+    }
+
+  g_slist_free (waiters);
+}
+
+static void
+_get_property_statuses (TpProxy      *conn,
+                        const GValue *value,
+                        const GError *error,
+                        gpointer      user_data,
+                        GObject      *weak_object)
+{
+  CacheEntry *entry = user_data;
+  GError wrong_type = { TP_ERRORS, TP_ERROR_NOT_IMPLEMENTED,
+      "Statuses has the wrong type" };
+
+  if (error == NULL &&
+      !G_VALUE_HOLDS (value, TP_HASH_TYPE_SIMPLE_STATUS_SPEC_MAP))
+    error = &wrong_type;
+
+  if (error != NULL)
+    {
+      /* don't cache the failure, the next connection can try again */
+      cache_entry_notify (entry, error);
+      g_hash_table_remove (cache, entry->key);
+      return;
+    }
+
+  entry->specs = status_specs_new (g_value_get_boxed (value));
+  cache_entry_notify (entry, NULL);
+}
+
+void
+status_cache_get_statuses (TpAccount           *account,
+                           TpConnection        *conn,
+                           StatusCacheCallback  callback,
+                           gpointer             user_data,
+                           GObject             *weak_object)
+{
+  g_return_if_fail (TP_IS_ACCOUNT (account));
+  g_return_if_fail (TP_IS_CONNECTION (conn));
+  g_return_if_fail (G_IS_OBJECT (weak_object));
+
+  if (cache == NULL)
+    cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+        NULL, (GDestroyNotify) cache_entry_free);
+
+  char *key = g_strdup_printf ("%s/%s",
+      tp_account_get_connection_manager (account),
+      tp_account_get_protocol (account));
+  CacheEntry *entry = g_hash_table_lookup (cache, key);
+
+  if (entry != NULL && entry->specs != NULL)
+    {
+      g_free (key);
+      callback (entry->specs, NULL, user_data, weak_object);
+      return;
+    }
+
+  Waiter *waiter = g_slice_new (Waiter);
+  waiter->callback = callback;
+  waiter->user_data = user_data;
+  waiter->weak_object = weak_object;
+  g_object_add_weak_pointer (weak_object, (gpointer *) &waiter->weak_object);
+
+  if (entry != NULL)
+    {
+      /* the statuses are already being fetched by another account */
+      g_free (key);
+      entry->waiters = g_slist_prepend (entry->waiters, waiter);
+      return;
+    }
+
+  entry = g_slice_new0 (CacheEntry);
+  entry->key = key;
+  entry->waiters = g_slist_prepend (NULL, waiter);
+  g_hash_table_insert (cache, entry->key, entry);
+
+  /* request the Statuses property */
+  tp_cli_dbus_properties_call_get (conn, -1,
+      TP_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE,
+      "Statuses",
+      _get_property_statuses,
+      entry, NULL, NULL);
+}
@@ -0,0 +1,40 @@
+/*
+ * status-cache.h
+ *
+ * Shared SimplePresence statuses for each CM and protocol
+ */
+
+#ifndef __STATUS_CACHE_H__
+#define __STATUS_CACHE_H__
+
+#include <telepathy-glib/account.h>
+#include <telepathy-glib/connection.h>
+
+G_BEGIN_DECLS
+
+/* a status the user can set on themselves */
+typedef struct _StatusSpec StatusSpec;
+struct _StatusSpec
+{
+  char *status;
+  TpConnectionPresenceType type;
+  gboolean can_have_message;
+};
+
+/* @specs is a GPtrArray of StatusSpec, sorted by status; it's shared by
+ * every account using the same CM and protocol, so take a reference with
+ * g_ptr_array_ref() to keep it */
+typedef void (* StatusCacheCallback) (GPtrArray *specs,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object);
+
+void status_cache_get_statuses (TpAccount *account,
+    TpConnection *conn,
+    StatusCacheCallback callback,
+    gpointer user_data,
+    GObject *weak_object);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,56 @@
+import bisect
+
+import gtk
+import gobject
+
+class RosterModel(gtk.ListStore):
+    """A list of contacts, kept in the order of Contact.sort_key().
+
+    Rather than have GTK+ sort the whole list, calling back into Python for
+    every comparison, the sort keys are kept in a list alongside the rows, and
+    a contact that changes is moved to its new place by a binary search.
+    """
+
+    def __init__(self):
+        super(RosterModel, self).__init__(gobject.TYPE_PYOBJECT)
+
+        # the sort key of each row, in the same order as the rows
+        self._order = []
+        # handle -> the sort key its row was placed with
+        self._keys = {}
+
+    def _index(self, handle):
+        return bisect.bisect_left(self._order, self._keys[handle])
+
+    def update(self, contact):
+        """Adds @contact, or moves it if its sort key has changed."""
+
+        key = contact.sort_key()
+
+        if contact.handle in self._keys:
+            old = self._index(contact.handle)
+
+            if self._keys[contact.handle] == key:
+                # it stays where it is, but it still needs redrawing
+                self.set(self.get_iter((old,)), 0, contact)
+                return
+
+            del self._order[old]
+            self.remove(self.get_iter((old,)))
+
+        i = bisect.bisect_left(self._order, key)
+        self._order.insert(i, key)
+        self._keys[contact.handle] = key
+        self.insert(i, (contact,))
+
+    def discard(self, handle):
+        """Removes the contact with @handle, if it's in the model."""
+
+        if handle not in self._keys: return
+
+        i = self._index(handle)
+        del self._order[i]
+        del self._keys[handle]
+        self.remove(self.get_iter((i,)))
+
+gobject.type_register(RosterModel)
@@ -2,6 +2,7 @@ import gtk
 import gobject
 
 from ChatWindow import ChatWindow
+from RosterModel import RosterModel
 
 class RosterWindow(gtk.Window):
 
@@ -17,7 +18,8 @@ class RosterWindow(gtk.Window):
         sw = gtk.ScrolledWindow()
         vbox.pack_start (sw)
 
-        self.contacts = gtk.ListStore(gobject.TYPE_PYOBJECT)
+        # the model keeps itself sorted as contacts change
+        self.contacts = RosterModel()
         tv = gtk.TreeView(self.contacts)
         sw.add(tv)
 
@@ -38,34 +40,14 @@ class RosterWindow(gtk.Window):
 
         column.set_cell_data_func(renderer, text_func)
 
-        def sort_func(model, iter1, iter2):
-            a = model.get_value(iter1, 0)
-            b = model.get_value(iter2, 0)
-            return cmp(a,b)
-
-        self.contacts.set_default_sort_func(sort_func)
-        self.contacts.set_sort_column_id(-1, gtk.SORT_ASCENDING)
-
     def _contacts_updated(self, sm, updated):
-        # build a set of contacts in the state machine
-        contacts = set(self.sm.contacts.values())
-        updated = set(updated)
-
-        # iterate through the liststore, updating the contacts
-        for row in self.contacts:
-            contact = row[0]
-
-            if contact in updated or \
-               contact not in contacts:
-                self.contacts.remove(row.iter)
-                continue
-
-            contacts.remove(contact)
-
-        # iterate through the remaining items in the set, adding them to the
-        # list store
-        for contact in contacts:
-            self.contacts.append ((contact,))
+        # only the updated contacts are moved, the rest of the roster is
+        # already in order
+        for contact in updated:
+            if self.sm.contacts.get(contact.handle) is contact:
+                self.contacts.update(contact)
+            else:
+                self.contacts.discard(contact.handle)
 
     def _new_chat(self, sm, channel):
         w = ChatWindow(channel)
@@ -168,21 +168,75 @@ class Contact(object):
         interfaces = list (set(interfaces) & set(sm.conn.interfaces))
         interfaces += [ CONNECTION ]
 
-        def _new_handle_attributes_cb(map):
-            for handle, attributes in map.iteritems():
-                contact = Contact (sm, handle, attributes)
-                sm.contacts[handle] = contact
-
-            sm.contacts_updated(map.keys())
+        # we can only look them up via the contacts interface
+        if CONNECTION_INTERFACE_CONTACTS not in sm.conn.interfaces: return
 
+        # contacts we already know about aren't looked up again
+        missing = set(h for h in handles if h not in sm.contacts)
+        if not missing:
             if callback is not None: callback()
+            return
+
+        remaining = [ len(missing) ]
+
+        def _handle_known():
+            remaining[0] -= 1
+            if remaining[0] == 0 and callback is not None: callback()
+
+        # handles that another lookup is already fetching share its reply
+        requested = []
+        for handle in missing:
+            if handle not in sm.pending:
+                sm.pending[handle] = []
+                requested.append(handle)
+
+            sm.pending[handle].append(_handle_known)
+
+        if not requested: return
+
+        def _get_attributes(handles, retry):
+            def _new_handle_attributes_cb(map):
+                for handle, attributes in map.iteritems():
+                    contact = Contact (sm, handle, attributes)
+
+                    # apply any changes signalled while we were waiting
+                    for key, value in sm.queued.pop(handle, {}).iteritems():
+                        setattr(contact, key, value)
+
+                    sm.contacts[handle] = contact
+
+                sm.contacts_updated(map.keys())
+
+                # handles missing from the map were invalid, but we're done
+                # waiting for them too
+                for handle in handles:
+                    sm.queued.pop(handle, None)
+                    for cb in sm.pending.pop(handle, []): cb()
+
+            def _error_cb(error):
+                print "Telepathy Error: %s" % error
+
+                # only this lookup fails; the handles that other lookups
+                # are also waiting for are asked for again on their behalf
+                shared = []
+                for handle in handles:
+                    waiting = sm.pending.get(handle, [])
+                    if _handle_known in waiting: waiting.remove(_handle_known)
+
+                    if waiting and retry:
+                        shared.append(handle)
+                    else:
+                        sm.queued.pop(handle, None)
+                        sm.pending.pop(handle, None)
+
+                if shared: _get_attributes(shared, False)
 
-        # look them up via the contacts interface
-        if CONNECTION_INTERFACE_CONTACTS in sm.conn.interfaces:
             sm.conn[CONNECTION_INTERFACE_CONTACTS].GetContactAttributes(
                 handles, interfaces, False,
                 reply_handler = _new_handle_attributes_cb,
-                error_handler = sm.error)
+                error_handler = _error_cb)
+
+        _get_attributes(requested, True)
 
     def get_state(self):
         return self.presence[0]
@@ -196,21 +250,24 @@ class Contact(object):
     def __repr__(self):
         return 'Contact(%s)' % self.contact_id
 
-    def __cmp__(self, other):
-        ordering_map = {
-            CONNECTION_PRESENCE_TYPE_AVAILABLE      : 0,
-            CONNECTION_PRESENCE_TYPE_BUSY           : 1,
-            CONNECTION_PRESENCE_TYPE_AWAY           : 2,
-            CONNECTION_PRESENCE_TYPE_EXTENDED_AWAY  : 3,
-            CONNECTION_PRESENCE_TYPE_UNSET          : 4,
-            CONNECTION_PRESENCE_TYPE_UNKNOWN        : 4,
-            CONNECTION_PRESENCE_TYPE_OFFLINE        : 5,
-        }
+    ordering_map = {
+        CONNECTION_PRESENCE_TYPE_AVAILABLE      : 0,
+        CONNECTION_PRESENCE_TYPE_BUSY           : 1,
+        CONNECTION_PRESENCE_TYPE_AWAY           : 2,
+        CONNECTION_PRESENCE_TYPE_EXTENDED_AWAY  : 3,
+        CONNECTION_PRESENCE_TYPE_UNSET          : 4,
+        CONNECTION_PRESENCE_TYPE_UNKNOWN        : 4,
+        CONNECTION_PRESENCE_TYPE_OFFLINE        : 5,
+    }
+
+    def sort_key(self):
+        # the handle breaks ties between contacts with the same alias, so
+        # every contact has a distinct key
+        return (self.ordering_map.get(self.get_state(), 4),
+                self.alias, self.handle)
 
-        c = cmp (ordering_map[self.get_state()], ordering_map[other.get_state()])
-        if c != 0: return c
-        c = cmp (self.alias, other.alias)
-        return c
+    def __cmp__(self, other):
+        return cmp (self.sort_key()[:2], other.sort_key()[:2])
 
 class StateMachine(gobject.GObject):
     __gsignals__ = {
@@ -225,6 +282,11 @@ class StateMachine(gobject.GObject):
 
         self.contacts = {}
 
+        # handle -> callbacks waiting for it, for handles being looked up
+        self.pending = {}
+        # handle -> { attribute : value }, for changes to pending handles
+        self.queued = {}
+
     def tp_connect(self, account, password):
         """e.g. account  = 'bob@example.com/test'
                 password = 'bigbob'
@@ -277,17 +339,23 @@ class StateMachine(gobject.GObject):
     def new_text_channel(self, channel):
         self.emit('new-chat', channel)
 
+    def _update_contact(self, handle, key, value):
+        if handle in self.contacts:
+            setattr(self.contacts[handle], key, value)
+        elif handle in self.pending:
+            # the contact is still being looked up, so remember the change
+            # until it arrives
+            self.queued.setdefault(handle, {})[key] = value
+
     def _aliases_changed(self, aliases):
         for handle, alias in aliases:
-            if handle not in self.contacts: continue
-            self.contacts[handle].alias = alias
+            self._update_contact(handle, 'alias', alias)
 
         self.contacts_updated(map(lambda (h, a): h, aliases))
 
     def _presences_changed(self, presences):
         for handle, presence in presences.iteritems():
-            if handle not in self.contacts: continue
-            self.contacts[handle].presence = presence
+            self._update_contact(handle, 'presence', presence)
 
         self.contacts_updated(presences.keys())
 
@@ -0,0 +1,170 @@
+#
+# A rule engine for deciding what to do with a dispatch operation without
+# asking the user.
+#
+# Rules are read from a file, one per line:
+#
+#   <action> <channel type> <handle type> <account> <target id> [<handler>]
+#
+# where action is one of handle, reject or defer; handle type is one of
+# none, contact, list, room or group; and any field but the action may be *
+# to match anything. Account and target id are shell-style patterns, e.g.
+#
+#   # let the tube handler take tubes from our colleagues straight away
+#   handle org.freedesktop.Telepathy.Channel.Type.DBusTube room * *@conference.example.com ExampleHandler
+#   reject * contact * spammer@*
+#
+# The first rule that matches a channel wins. Rules are indexed by channel
+# type and then target handle type, so only the rules that could apply to a
+# channel's type are tried against its account and target id.
+#
+import fnmatch
+import re
+
+from telepathy.interfaces import CHANNEL
+from telepathy.constants import HANDLE_TYPE_NONE, \
+                                HANDLE_TYPE_CONTACT, \
+                                HANDLE_TYPE_LIST, \
+                                HANDLE_TYPE_ROOM, \
+                                HANDLE_TYPE_GROUP
+
+HANDLE = 'handle'
+REJECT = 'reject'
+DEFER = 'defer'
+
+ACTIONS = [ HANDLE, REJECT, DEFER ]
+
+HANDLE_TYPES = {
+    'none': HANDLE_TYPE_NONE,
+    'contact': HANDLE_TYPE_CONTACT,
+    'list': HANDLE_TYPE_LIST,
+    'room': HANDLE_TYPE_ROOM,
+    'group': HANDLE_TYPE_GROUP,
+}
+
+class Rule(object):
+    def __init__(self, order, action, channel_type=None, handle_type=None,
+                 account=None, target_id=None, handler=None):
+        if action not in ACTIONS:
+            raise ValueError("unknown action '%s'" % action)
+
+        self.order = order
+        self.action = action
+        self.channel_type = channel_type
+        self.handle_type = handle_type
+        self.handler = handler
+
+        # patterns are compiled once, None matches anything
+        self._account = account and re.compile(fnmatch.translate(account))
+        self._target_id = target_id and \
+            re.compile(fnmatch.translate(target_id))
+
+    def __repr__(self):
+        return 'Rule(%u, %s)' % (self.order, self.action)
+
+    def matches(self, account, target_id):
+        return (self._account is None or
+                self._account.match(account) is not None) and \
+               (self._target_id is None or
+                self._target_id.match(target_id or '') is not None)
+
+class RuleSet(object):
+    def __init__(self, rules):
+        # channel type -> handle type -> rules, None matches any type
+        self._index = {}
+        # (channel type, handle type) -> the rules that could apply to it,
+        # in order, including the wildcard rules
+        self._candidates = {}
+
+        for rule in rules:
+            self._index.setdefault(rule.channel_type, {}) \
+                       .setdefault(rule.handle_type, []) \
+                       .append(rule)
+
+    @classmethod
+    def load(cls, path):
+        rules = []
+
+        for lineno, line in enumerate(open(path)):
+            fields = line.split('#', 1)[0].split()
+            if not fields:
+                continue
+
+            if len(fields) not in (5, 6):
+                raise ValueError('%s:%u: expected 5 or 6 fields' %
+                    (path, lineno + 1))
+
+            action, channel_type, handle_type, account, target_id = \
+                [ f != '*' and f or None for f in fields[:5] ]
+
+            if handle_type is not None:
+                if handle_type not in HANDLE_TYPES:
+                    raise ValueError("%s:%u: unknown handle type '%s'" %
+                        (path, lineno + 1, handle_type))
+                handle_type = HANDLE_TYPES[handle_type]
+
+            handler = len(fields) == 6 and fields[5] or None
+
+            rules.append(Rule(len(rules), action, channel_type, handle_type,
+                account, target_id, handler))
+
+        return cls(rules)
+
+    def _get_candidates(self, channel_type, handle_type):
+        key = (channel_type, handle_type)
+
+        try:
+            return self._candidates[key]
+        except KeyError:
+            pass
+
+        candidates = []
+        for ct in set([ channel_type, None ]):
+            by_handle_type = self._index.get(ct, {})
+            for ht in set([ handle_type, None ]):
+                candidates += by_handle_type.get(ht, [])
+
+        candidates.sort(key=lambda rule: rule.order)
+        self._candidates[key] = candidates
+
+        return candidates
+
+    def match(self, account, properties):
+        """Returns the first rule matching the channel with immutable
+           properties @properties on @account, or None"""
+
+        for rule in self._get_candidates(
+                properties.get(CHANNEL + '.ChannelType'),
+                properties.get(CHANNEL + '.TargetHandleType')):
+            if rule.matches(account, properties.get(CHANNEL + '.TargetID')):
+                return rule
+
+        return None
+
+    def decide(self, account, channels):
+        """Decides what to do with a dispatch operation of @channels, a list
+           of (object path, properties) on @account.
+
+           Returns the action and, for HANDLE, the handler to use, which may
+           be None to leave it to the Channel Dispatcher. Every channel has to
+           match a HANDLE rule to be handled; any channel matching a REJECT
+           rule rejects the whole operation; anything else is deferred."""
+
+        handlers = set()
+        deferred = False
+
+        for path, properties in channels:
+            rule = self.match(account, properties)
+
+            if rule is None or rule.action == DEFER:
+                deferred = True
+            elif rule.action == REJECT:
+                return REJECT, None
+            else:
+                handlers.add(rule.handler)
+
+        if deferred or len(handlers) != 1:
+            # the channels want different handlers, let someone else choose
+            return DEFER, None
+
+        return HANDLE, handlers.pop()
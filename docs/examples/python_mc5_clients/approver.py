@@ -1,3 +1,5 @@
+import sys
+
 import dbus.glib
 import gobject
 import telepathy
@@ -5,7 +7,12 @@ import telepathy
 from telepathy.server import Approver, DBusProperties
 from telepathy.interfaces import CLIENT, \
                                  CLIENT_APPROVER, \
-                                 CHANNEL
+                                 CHANNEL, \
+                                 CHANNEL_DISPATCHER, \
+                                 CHANNEL_DISPATCH_OPERATION
+
+import dispatch_stats
+from approval_rules import RuleSet, HANDLE, REJECT
 
 DBUS_PROPERTIES = "org.freedesktop.DBus.Properties"
 
@@ -22,12 +29,15 @@ class ExampleApprover(Approver, DBusProperties):
         },
     }
 
-    def __init__(self, client_name):
+    def __init__(self, client_name, rules):
+        self.rules = rules
+
         bus_name = '.'.join ([CLIENT, client_name])
         object_path = '/' + bus_name.replace('.', '/')
 
         bus_name = dbus.service.BusName(bus_name, bus=dbus.SessionBus())
         Approver.__init__(self, bus_name, object_path)
+        dispatch_stats.publish(bus_name)
 
     def GetAll(self, interface):
         print "GetAll", interface
@@ -45,21 +55,84 @@ class ExampleApprover(Approver, DBusProperties):
             return 0
 
     def AddDispatchOperation(self, channels, dispatch, properties):
-        print "Incoming channels:"
-        for object, props in channels:
-            print " - %s :: %s" % (props[CHANNEL + '.ChannelType'],
-                                   props[CHANNEL + '.TargetID'])
-	# if we return from our approver without raising an error, it's assumed
-	# that we accept the request and we're waiting for user feedback.
-	# if this is the only approver, and we then do nothing with the request
-	# it will get stuck and never be handled.
-	raise Exception("not interested")
-
-def start():
-    ExampleApprover("ExampleApprover")
+        timer = dispatch_stats.DispatchTimer('AddDispatchOperation')
+        timer.mark('calls')
+
+        try:
+            print "Incoming channels:"
+            for object, props in channels:
+                print " - %s :: %s" % (props[CHANNEL + '.ChannelType'],
+                                       props[CHANNEL + '.TargetID'])
+
+            # decide straight away from the rules, rather than asking the
+            # user
+            account = properties[CHANNEL_DISPATCH_OPERATION + '.Account']
+            action, handler = self.rules.decide(account, channels)
+            print " => %s" % action
+
+            # act on the decision once we've returned from
+            # AddDispatchOperation
+            if action == HANDLE:
+                gobject.idle_add(self.handle_with, dispatch, handler)
+            elif action == REJECT:
+                gobject.idle_add(self.reject, dispatch, properties, channels)
+            else:
+                # if we return from our approver without raising an error,
+                # it's assumed that we accept the request and we're waiting
+                # for user feedback. if this is the only approver, and we
+                # then do nothing with the request it will get stuck and
+                # never be handled.
+                raise Exception("not interested")
+        finally:
+            timer.finish()
+
+    def handle_with(self, dispatch, handler):
+        # an empty handler lets the Channel Dispatcher choose
+        if handler is not None:
+            handler = '.'.join ([CLIENT, handler])
+        else:
+            handler = ''
+
+        cdo = dbus.SessionBus().get_object(CHANNEL_DISPATCHER, dispatch)
+        cdo.HandleWith(handler, dbus_interface=CHANNEL_DISPATCH_OPERATION,
+            reply_handler=lambda: None, error_handler=self.error)
+
+        return False
+
+    def reject(self, dispatch, properties, channels):
+        bus = dbus.SessionBus()
+        connection = properties[CHANNEL_DISPATCH_OPERATION + '.Connection']
+        service_name = connection.replace('/', '.')[1:]
+
+        # once we've claimed the channels no one else will handle them, so we
+        # can close them
+        def claimed():
+            for object_path, props in channels:
+                channel = bus.get_object(service_name, object_path)
+                channel.Close(dbus_interface=CHANNEL,
+                    reply_handler=lambda: None, error_handler=self.error)
+
+        cdo = bus.get_object(CHANNEL_DISPATCHER, dispatch)
+        cdo.Claim(dbus_interface=CHANNEL_DISPATCH_OPERATION,
+            reply_handler=claimed, error_handler=self.error)
+
+        return False
+
+    def error(self, e):
+        print "Error:", e
+
+def start(rules_path):
+    # without a rules file every dispatch operation is deferred
+    if rules_path is not None:
+        rules = RuleSet.load(rules_path)
+    else:
+        rules = RuleSet([])
+
+    ExampleApprover("ExampleApprover", rules)
     return False
 
 if __name__ == '__main__':
-    gobject.timeout_add(0, start)
+    # approver.py [RULES]
+    gobject.timeout_add(0, start, len(sys.argv) > 1 and sys.argv[1] or None)
     loop = gobject.MainLoop()
     loop.run()
@@ -0,0 +1,111 @@
+#
+# Histograms of how long each dispatch method takes, exported on D-Bus in
+# the same form as the C examples' DispatchStats object.
+#
+# Each call is timed from when it's received to when it returns, split into
+# preparing proxies, making the per-channel calls and waiting for their
+# replies.
+#
+import time
+
+import dbus
+import dbus.service
+
+import telepathy
+
+DISPATCH_STATS = 'org.freedesktop.Telepathy.Examples.DispatchStats'
+DISPATCH_STATS_PATH = '/org/freedesktop/Telepathy/Examples/DispatchStats'
+
+# each bucket counts the calls that took less than its bound in ms, the last
+# bucket counts everything slower
+BUCKET_BOUNDS = [ 1 << i for i in range(15) ]
+
+PHASES = [ 'prepare', 'calls', 'wait' ]
+
+_stats = None
+
+class DispatchStats(telepathy.server.DBusProperties):
+    def __init__(self, bus_name):
+        dbus.service.Object.__init__(self, bus_name, DISPATCH_STATS_PATH)
+        telepathy.server.DBusProperties.__init__(self)
+
+        # 'Method' or 'Method.phase' -> list of bucket counts
+        self.histograms = {}
+
+        self._implement_property_get(DISPATCH_STATS, {
+            'Histograms': lambda: dbus.Dictionary(
+                    [ (name, dbus.Array(buckets, signature='u'))
+                      for name, buckets in self.histograms.iteritems() ],
+                    signature='sau'),
+            'BucketBounds': lambda: dbus.Array(BUCKET_BOUNDS, signature='u'),
+          })
+
+    def record(self, name, ms):
+        buckets = self.histograms.setdefault(name,
+            [ 0 ] * (len(BUCKET_BOUNDS) + 1))
+
+        for bucket, bound in enumerate(BUCKET_BOUNDS):
+            if ms < bound:
+                break
+        else:
+            bucket = len(BUCKET_BOUNDS)
+
+        buckets[bucket] += 1
+
+def publish(bus_name):
+    """Exports the process's stats object alongside the client on @bus_name"""
+    global _stats
+
+    if _stats is None:
+        _stats = DispatchStats(bus_name)
+
+    return _stats
+
+class DispatchTimer(object):
+    """Times one call of @method, from when it's created"""
+
+    def __init__(self, method):
+        self.method = method
+        self.start = time.time()
+        self.phase = 'prepare'
+        self.phase_start = self.start
+        self.phases = dict.fromkeys(PHASES, 0.)
+
+    def mark(self, phase):
+        """Ends the current phase and starts @phase"""
+        now = time.time()
+
+        self.phases[self.phase] += (now - self.phase_start) * 1000
+        self.phase = phase
+        self.phase_start = now
+
+    def finish(self):
+        """Records the call's time to return and each phase's share of it"""
+        self.mark(self.phase)
+
+        if _stats is None:
+            return
+
+        _stats.record(self.method, (time.time() - self.start) * 1000)
+        for phase in PHASES:
+            _stats.record('%s.%s' % (self.method, phase), self.phases[phase])
+
+def timed(method):
+    """Decorates a dispatch method that makes no calls of its own, timing
+    each call of it as @method"""
+
+    def decorator(func):
+        def wrapper(self, *args, **kwargs):
+            timer = DispatchTimer(method)
+            timer.mark('calls')
+
+            try:
+                return func(self, *args, **kwargs)
+            finally:
+                timer.finish()
+
+        wrapper.__name__ = func.__name__
+        wrapper.__doc__ = func.__doc__
+        return wrapper
+
+    return decorator
@@ -10,6 +10,8 @@ from telepathy.interfaces import CLIENT, \
 from telepathy.constants import HANDLE_TYPE_ROOM, \
                                 SOCKET_ACCESS_CONTROL_LOCALHOST
 
+import dispatch_stats
+
 class ExampleHandler(telepathy.server.Observer,
                      telepathy.server.Handler,
                      telepathy.server.DBusProperties):
@@ -59,16 +61,25 @@ class ExampleHandler(telepathy.server.Observer,
 
     def ObserveChannels(self, account, connection, channels, dispatch_operation,
                         requests_satisfied, observer_info):
+        timer = dispatch_stats.DispatchTimer('ObserveChannels')
+        timer.mark('calls')
+
         print "Incoming channels on %s:" % (connection)
         for object, props in channels:
             print " - %s :: %s" % (props[CHANNEL + '.ChannelType'],
                                    props[CHANNEL + '.TargetID'])
 
+        timer.finish()
+
     def HandleChannels(self, account, connection, channels, requests_satisfied,
                        user_action_time, handler_info):
 
+        timer = dispatch_stats.DispatchTimer('HandleChannels')
+
         service_name = connection.replace('/', '.')[1:]
 
+        timer.mark('calls')
+
         for object_path, props in channels:
             if props[CHANNEL + '.ChannelType'] != CHANNEL_TYPE_DBUS_TUBE or \
                props[CHANNEL_TYPE_DBUS_TUBE + '.ServiceName'] != 'org.freedesktop.Telepathy.Examples.TubeClient':
@@ -81,6 +92,8 @@ class ExampleHandler(telepathy.server.Observer,
             channel[CHANNEL].connect_to_signal('Closed',
                 lambda: self.channel_closed(channel))
 
+        timer.finish()
+
     def channel_closed(self, channel):
         print "Remove channel", channel.object_path
         self._channels.remove(channel)
@@ -93,6 +106,7 @@ def publish(client_name):
     bus_name = dbus.service.BusName(bus_name, bus=dbus.SessionBus())
 
     ExampleHandler(bus_name, object_path)
+    dispatch_stats.publish(bus_name)
     return False
 
 if __name__ == '__main__':
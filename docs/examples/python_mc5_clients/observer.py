@@ -6,6 +6,8 @@ from telepathy.interfaces import CLIENT, \
                                  CLIENT_OBSERVER, \
                                  CHANNEL
 
+import dispatch_stats
+
 # begin ex.services.python.object
 class ExampleObserver(telepathy.server.Observer,
                       telepathy.server.DBusProperties):
@@ -32,6 +34,10 @@ class ExampleObserver(telepathy.server.Observer,
                                    props[CHANNEL + '.TargetID'])
 # end ex.services.python.object
 
+# time each call, outside the example above
+ExampleObserver.ObserveChannels = dispatch_stats.timed('ObserveChannels')(
+    ExampleObserver.__dict__['ObserveChannels'])
+
 # begin ex.services.python.publishing
 def publish(client_name):
     bus_name = '.'.join ([CLIENT, client_name])
@@ -41,6 +47,7 @@ def publish(client_name):
 
     ExampleObserver(bus_name, object_path)
 # end ex.services.python.publishing
+    dispatch_stats.publish(bus_name)
     return False
 
 if __name__ == '__main__':
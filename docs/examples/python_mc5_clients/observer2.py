@@ -20,6 +20,8 @@ import telepathy
 from telepathy.interfaces import *
 from telepathy.constants import *
 
+import dispatch_stats
+
 DBUS_PROPERTIES = 'org.freedesktop.DBus.Properties'
 
 def error(e):
@@ -37,6 +39,11 @@ class EConnection(gobject.GObject,
         self.ready_handler = ready_handler
         self.signals = []
 
+        # handle -> callbacks waiting for its contact attributes, requested
+        # together from an idle
+        self._attribute_requests = {}
+        self._attribute_idle = None
+
         gobject.GObject.__init__(self)
         telepathy.client.Connection.__init__(self, service_name, path,
             ready_handler=self._connection_ready)
@@ -65,6 +72,45 @@ class EConnection(gobject.GObject,
         self.signals.append(self[CONNECTION].connect_to_signal(
             'StatusChanged', self._status_changed))
 
+    def get_contact_attributes(self, handle, callback):
+        """Calls @callback with the contact attributes of @handle, or None if
+           they couldn't be retrieved.
+
+           Requests made while dispatching the same burst of events, such as
+           the channels of one ObserveChannels becoming ready, are sent as a
+           single GetContactAttributes call."""
+
+        self._attribute_requests.setdefault(handle, []).append(callback)
+
+        if self._attribute_idle is None:
+            self._attribute_idle = gobject.idle_add(
+                self._flush_attribute_requests)
+
+    def _flush_attribute_requests(self):
+        requests = self._attribute_requests
+        self._attribute_requests = {}
+        self._attribute_idle = None
+
+        def reply(attributes_map):
+            for handle, callbacks in requests.iteritems():
+                for callback in callbacks:
+                    callback(attributes_map.get(handle))
+
+        def attributes_error(e):
+            error(e)
+
+            for callbacks in requests.itervalues():
+                for callback in callbacks:
+                    callback(None)
+
+        self[CONNECTION_INTERFACE_CONTACTS].GetContactAttributes(
+            requests.keys(),
+            self.contact_attribute_interfaces,
+            False,
+            reply_handler=reply, error_handler=attributes_error)
+
+        return False
+
     def do_disconnect(self):
         # required so that we don't transmit this over D-Bus
         pass
@@ -126,13 +172,11 @@ class EChannel(gobject.GObject,
             # we're ready
             self.ready_handler(self)
 
-        def get_target_handle_alias(attributes_map):
-            if handle not in attributes_map:
+        def get_target_handle_alias(attributes):
+            if attributes is None:
                 error('Handle %u not known, weird' % handle)
                 self._target_alias = self.properties[CHANNEL + '.TargetID']
             else:
-                attributes = attributes_map[handle]
-
                 self._target_alias = \
                     attributes.get(CONNECTION_INTERFACE_ALIASING + '/alias',
                         self.properties[CHANNEL + '.TargetID'])
@@ -141,12 +185,9 @@ class EChannel(gobject.GObject,
             self[CHANNEL_TYPE_TEXT].ListPendingMessages(False,
                 reply_handler=pending_messages_reply, error_handler=error)
 
-        # look up the TargetHandle
-        self.conn[CONNECTION_INTERFACE_CONTACTS].GetContactAttributes(
-            [ handle ],
-            self.conn.contact_attribute_interfaces,
-            False,
-            reply_handler=get_target_handle_alias, error_handler=error)
+        # look up the TargetHandle, along with those of any other channels
+        # becoming ready at the same time
+        self.conn.get_contact_attributes(handle, get_target_handle_alias)
 
         # connect the signals we care about
         self.signals.append(self[CHANNEL].connect_to_signal(
@@ -189,6 +230,8 @@ class EObserver(telepathy.server.Observer,
     def ObserveChannels(self, account, connection, channels, dispatch_operation,
                         requests_satisfied, observer_info, _success, _error):
 
+        timer = dispatch_stats.DispatchTimer('ObserveChannels')
+
         # this is a list of pending channel requests that we're waiting to be
         # ready for this request before we return _success()
         pending_channels = []
@@ -207,14 +250,19 @@ class EObserver(telepathy.server.Observer,
                 print 'All channels ready'
 
                 _success()
+                timer.finish()
 
         def open_channels(conn):
             print "Opening channels"
+            timer.mark('calls')
+
             for path, properties in channels:
                 chan = self.channels[path] = EChannel(account, conn, path,
                     properties, channel_ready)
                 pending_channels.append(chan)
 
+            timer.mark('wait')
+
         def connection_disconnected(conn):
             print '%s disconnected' % conn
             del self.connections[conn.object_path]
@@ -240,6 +288,7 @@ def publish(client_name):
     bus_name = dbus.service.BusName(service_name, bus=dbus.SessionBus())
 
     EObserver(bus_name, object_path)
+    dispatch_stats.publish(bus_name)
     return False
 
 if __name__ == '__main__':
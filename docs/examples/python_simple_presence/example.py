@@ -100,7 +100,55 @@ class Example (object):
     def request_contact_list (self, *groups):
         conn = self.conn
 
-        class ensure_channel_cb (object):
+        class roster_aggregator (object):
+            """Collects the members of every list before fetching their
+               attributes, so that a contact on several lists is only
+               fetched once.
+            """
+
+            def __init__ (self, parent, groups):
+                self.parent = parent
+                self.waiting = set(groups)
+                # group -> (ensure_channel_cb, members)
+                self.lists = {}
+
+            def add_members (self, list_cb, handles):
+                self.lists[list_cb.group] = (list_cb, handles)
+                self.list_done(list_cb.group)
+
+            def list_done (self, group):
+                self.waiting.discard(group)
+                if self.waiting: return
+
+                # the union of every list's members
+                handles = set()
+                for list_cb, members in self.lists.itervalues():
+                    handles.update(members)
+
+                if not handles: return
+
+                # request information for every contact at once using the
+                # Contacts interface
+                conn[CONNECTION_INTERFACE_CONTACTS].GetContactAttributes(
+                    list(handles), [
+                        CONNECTION,
+                        CONNECTION_INTERFACE_ALIASING,
+                        CONNECTION_INTERFACE_SIMPLE_PRESENCE,
+                    ],
+                    False,
+                    reply_handler = self.get_contact_attributes_cb,
+                    error_handler = self.parent.error_cb)
+
+            def get_contact_attributes_cb (self, attributes):
+                # hand each list the attributes of its own members
+                for list_cb, members in self.lists.itervalues():
+                    list_cb.get_contact_attributes_cb(dict(
+                        (handle, attributes[handle])
+                        for handle in members if handle in attributes))
+
+        aggregator = roster_aggregator(self, groups)
+
+        class contact_list_cb (object):
             def __init__ (self, parent, group):
                 self.parent = parent
                 self.group = group
@@ -117,7 +165,7 @@ class Example (object):
                 channel[DBUS_PROPERTIES].Get(CHANNEL_INTERFACE_GROUP,
                                          'Members',
                                          reply_handler = self.members_cb,
-                                         error_handler = self.parent.error_cb)
+                                         error_handler = self.members_error_cb)
 
             def members_cb (self, handles):
                 # request information for this list of handles using the
@@ -131,6 +179,9 @@ class Example (object):
                     False,
                     reply_handler = self.get_contact_attributes_cb,
                     error_handler = self.parent.error_cb)
+
+            def members_error_cb (self, error):
+                print error
                 # end ex.channel.groups.getting-members
 
             def get_contact_attributes_cb (self, attributes):
@@ -145,8 +196,27 @@ class Example (object):
                     print
                 print '-' * 78
 
-        def no_channel_available (error):
-            print error
+        class ensure_channel_cb (contact_list_cb):
+            """Hands each list's members to the aggregator rather than
+               requesting their attributes itself.
+            """
+
+            def members_cb (self, handles):
+                aggregator.add_members(self, handles)
+
+            def members_error_cb (self, error):
+                contact_list_cb.members_error_cb(self, error)
+                # don't hold up the other lists
+                aggregator.list_done(self.group)
+
+        class no_channel_available (object):
+            def __init__ (self, group):
+                self.group = group
+
+            def __call__ (self, error):
+                print error
+                # don't hold up the other lists
+                aggregator.list_done(self.group)
 
         # we can either use TargetID if we know a name, or TargetHandle
         # if we already have a handle
@@ -159,7 +229,7 @@ class Example (object):
                 CHANNEL + '.TargetID'        : group,
                 },
                 reply_handler = ensure_channel_cb(self, group),
-                error_handler = no_channel_available)
+                error_handler = no_channel_available(group))
             # end ex.channel.contactlist.ensurechannel
 
     def get_interfaces_cb (self, interfaces):